@@ -12,8 +12,13 @@
 #include <string.h>
 #include <stddef.h>
 #include "net/rime.h"
+#if DTN_STORE_CFS
+#include "cfs/cfs.h"
+#endif
+#if DTN_ENERGY
+#include "sys/energest.h"
+#endif
 
-#define DTN_CSVLOG 0      /**< 0 - Off, 1 - On */
 #define DTN_DEBUG_LEVEL 0 /**< 0 - Nothing, 1 - Important only, 2 - ALL */
 
 #if DTN_DEBUG_LEVEL >= 2
@@ -33,20 +38,151 @@
 #define IMPTADDR(addr)
 #endif
 
-#if DTN_CSVLOG
-#define CSVLOG_PACKBUF(func) csvlog_packetbuf(func)
+#define DTN_STORE_CONN(s) \
+  ((struct dtn_conn *)((void *)(s) - offsetof(struct dtn_conn, store)))
+#if DTN_STATS
+#define DTN_STAT(c, counter) ((c)->stats.counter++)
+#else
+#define DTN_STAT(c, counter)
+#endif
+#if DTN_TRACE
+#define DTN_TRACE_EVENT(c, event, esender, epacketid, peer, num_copies) \
+  dtn_trace(c, event, esender, epacketid, peer, num_copies)
+#else
+#define DTN_TRACE_EVENT(c, event, esender, epacketid, peer, num_copies)
+#endif
+
+#define DTN_FREE 0
+#define DTN_PENDING 1
+#define DTN_READY 2
+
+#define DTN_MAGIC 'S'
+#define DTN_MAGIC_BUNDLE 'W'
+#define DTN_MAGIC_ADV 'A'
+#define DTN_MAGIC_SV 'V'
+#define DTN_MAGIC_TOMB 'D'
+#define DTN_MAGIC_BEACON 'B'
+#define DTN_MAGIC_PACKED 'P'
+
+#define DTN_FLAG_ACK_REQ 0x01
+#define DTN_FLAG_ACK 0x02
+#define DTN_FLAG_FRAG 0x04
+#define DTN_FLAG_BATCH 0x08
+#define DTN_FLAG_LOAD 0x10
+#define DTN_FLAG_GROUP 0x20
+
+#define DTN_ENCOUNTER_NEVER 0xffff
+#define DTN_ROOM_UNKNOWN 0xff
+
+#define DTN_HDR_RAW 0
+#define DTN_HDR_RAW_VERSION 1
+#define DTN_HDR_PACKED 1
+#define DTN_HDR_UNKNOWN 0xff
+#define DTN_HDR_LIFETIME 0x04
+#define DTN_HDR_ENCOUNTER 0x02
+#define DTN_HDR_FLAGS 0x01
+#define DTN_HDR_MAX_LEN (2 * RIMEADDR_SIZE + 14) // packed, every field set
+#define DTN_REQUEST_ENTRY (RIMEADDR_SIZE + 4) // origin, seqno and encounter
+#define DTN_ADV_ENTRY (2 * RIMEADDR_SIZE + 5) // and destination and L value
+#define DTN_TOMB_ENTRY (RIMEADDR_SIZE + 4) // origin, seqno and lifetime
+
+#if DTN_MAX_COPIES > 255
+#error "The L value is one byte in the header, DTN_MAX_COPIES is too high."
+#endif
+#if DTN_FRAG_MAX > 255
+#error "The fragment count is one byte in the header, DTN_FRAG_MAX is too high."
+#endif
+#if DTN_FRAG_MAX && DTN_FRAG_SIZE + 2 * RIMEADDR_SIZE + 11 > PACKETBUF_SIZE
+#error "DTN_FRAG_SIZE does not fit in the packet buffer with the header."
+#endif
+
+#if DTN_GROUPS > 255 || DTN_GROUP_MEMBERS > 255
+#error "DTN_GROUPS and DTN_GROUP_MEMBERS must be at most 255."
+#endif
+#if DTN_CONGESTION < 0 || DTN_CONGESTION > 100
+#error "DTN_CONGESTION is a percentage of the store."
+#endif
+#if DTN_POWER_CONTROL && 2 * DTN_POWER_DENSITY > DTN_NEIGHBOURS
+#error "DTN_NEIGHBOURS must be at least twice DTN_POWER_DENSITY."
+#endif
+#if DTN_BATCH < 1 || DTN_BATCH > 255
+#error "DTN_BATCH must be between 1 and 255."
+#endif
+#if DTN_BATCH > 1 && (DTN_BATCH - 1) * DTN_REQUEST_ENTRY + 2 * RIMEADDR_SIZE \
+                     + 7 > PACKETBUF_SIZE
+#error "A request naming DTN_BATCH bundles does not fit in the packet buffer."
+#endif
+
+#define DTN_STORE_SLOT(i) (sizeof(uint16_t) + (cfs_offset_t)(i) \
+                           * (sizeof(struct dtn_store_rec) + PACKETBUF_SIZE))
+
+#define DTN_TX_SPRAY 0
+#define DTN_TX_ROUND 1
+#define DTN_TX_ADV 2
+#define DTN_TX_SV 3
+#define DTN_TX_BEACON 4
+#define DTN_TX_TOMB 5
+#define DTN_TX_REQUEST 6
+#define DTN_TX_HANDOFF 7
+#define DTN_TX_NO_SLOT 0xffff
+
+#define DTN_TX_JITTER (CLOCK_SECOND / 64 + 1)
+#define DTN_BATCH_HOLD (DTN_BATCH * DTN_TX_JITTER)
+#define DTN_SPRAY_MIN_INTERVAL ((clock_time_t)DTN_SPRAY_DELAY * CLOCK_SECOND)
+#define DTN_SPRAY_MAX_INTERVAL (DTN_SPRAY_MIN_INTERVAL << DTN_SPRAY_DOUBLINGS)
+#define DTN_BEACON_INTERVAL ((clock_time_t)DTN_BEACON * CLOCK_SECOND)
+#if DTN_BEACON
+#define DTN_NEIGHBOUR_TIMEOUT (3 * DTN_BEACON_INTERVAL)
 #else
-#define CSVLOG_PACKBUF(func)
+#define DTN_NEIGHBOUR_TIMEOUT (2 * DTN_SPRAY_MAX_INTERVAL)
 #endif
+#define DTN_POWER_INTERVAL ((clock_time_t)DTN_POWER_CONTROL * CLOCK_SECOND)
+#define DTN_POWER_STEP 1
+#define DTN_SV_MIN_INTERVAL CLOCK_SECOND
+#define DTN_TOMB_DELAY (CLOCK_SECOND / 2)
+#define DTN_ADV_HOLDOFF (2 * DTN_SPRAY_MIN_INTERVAL)
+#define DTN_ADV_NEAR DTN_SPRAY_DELAY
+#define DTN_TOMB_MAX_ENTRIES ((PACKETBUF_SIZE - sizeof(struct dtn_tomb_hdr)) \
+                              / DTN_TOMB_ENTRY)
 
-#define DTN_PENDING (void*)(0)
-#define DTN_READY (void*)(1)
+/* The header of the version 1 nodes deployed, sent as the struct itself. */
+struct dtn_hdr_raw {
+  uint8_t version;
+  uint8_t magic[2];
+  uint16_t num_copies;
+  rimeaddr_t esender;
+  rimeaddr_t ereceiver;
+  uint16_t epacketid;
+};
+
+/*
+ * The header of the message in the packet buffer, decoded. Like the packet
+ * buffer it only holds a message for the duration of a callback.
+ */
+static struct dtn_hdr dtn_buf_hdr;
 
 struct dtn_hdr * dtn_buf_ptr(void);
 int dtn_valid_hdr(void);
+void dtn_queue_spray(void *ptr);
+struct dtn_tx * dtn_tx_add(struct dtn_conn *c, uint8_t type,
+                           struct dtn_bundle *b);
+int dtn_originate(struct dtn_conn *c, struct dtn_hdr *hdr);
+uint16_t dtn_encounter_age(struct dtn_conn *c, const rimeaddr_t *addr);
+uint8_t dtn_spray_version(struct dtn_conn *c);
+int dtn_neighbours_around(struct dtn_conn *c);
+struct dtn_handoff * dtn_handoff_slot(struct dtn_conn *c, const rimeaddr_t *to,
+                                      struct dtn_bundle *b,
+                                      struct dtn_handoff *h);
+void dtn_tx_take(struct dtn_conn *c, uint16_t i, struct dtn_tx *tx);
+#if DTN_ENERGY
+unsigned long dtn_energy_add(struct dtn_conn *c, uint8_t type,
+                             unsigned long since);
+#endif
+#if DTN_CONGESTION
+void dtn_load_stamp(struct dtn_conn *c, struct dtn_hdr *hdr);
+void dtn_load_append(struct dtn_conn *c);
+#endif
 
-/*-MESSAGE QUEUE-------------------------------------------------------------*/
-PACKETQUEUE(dtn_packetqueue, DTN_QUEUE_MAX);
 /*-DEBUG FUNCTIONS-----------------------------------------------------------*/
 void
 print_packetbuf(char *func)
@@ -60,368 +196,3211 @@ print_packetbuf(char *func)
   INFOADDR(&(hdrptr->ereceiver));
   INFO(", ep: %d}, ", hdrptr->epacketid);
   INFO("data: {len: %d, s: %s}\n",
-       packetbuf_totlen() - sizeof(struct dtn_hdr),
-       hdrptr + 1);
-}
-/*---------------------------------------------------------------------------*/
-void
-csvlog_packetbuf(char *func)
-{
-  struct dtn_hdr *buf;
-  rimeaddr_t *addr;
-  printf("%s, ", func);
-  addr = (rimeaddr_t *)packetbuf_addr(PACKETBUF_ADDR_SENDER);
-  printf("%02x%02x:%02x%02x, ",
-         addr->u8[3], addr->u8[2], addr->u8[1], addr->u8[0]);
-  addr = (rimeaddr_t *)packetbuf_addr(PACKETBUF_ADDR_RECEIVER);
-  printf("%02x%02x:%02x%02x, ",
-         addr->u8[3], addr->u8[2], addr->u8[1], addr->u8[0]);
-  if (dtn_valid_hdr()) {
-    buf = dtn_buf_ptr();
-    addr = &(buf->esender);
-    printf("%02x%02x:%02x%02x, ",
-         addr->u8[3], addr->u8[2], addr->u8[1], addr->u8[0]);
-    addr = &(buf->ereceiver);
-    printf("%02x%02x:%02x%02x, ",
-         addr->u8[3], addr->u8[2], addr->u8[1], addr->u8[0]);
-    printf("%d, %d\n", buf->epacketid, buf->num_copies);
-  } else {
-    printf("X, X, X, X\n");
-  }
+       packetbuf_datalen(),
+       (char *)packetbuf_dataptr());
 }
-/*-LOCAL FUNCTIONS-----------------------------------------------------------*/
+/*---------------------------------------------------------------------------*/
+#if DTN_TRACE
+/* Record an event in the trace ring, over the oldest one if it is full. */
 void
-dtn_delay(void)
+dtn_trace(struct dtn_conn *c, uint8_t event, const rimeaddr_t *esender,
+          uint16_t epacketid, const rimeaddr_t *peer, uint16_t num_copies)
 {
-  clock_delay_usec(random_rand() % 10000 + 10000);
+  struct dtn_trace_rec *r;
+  if (c->trace_len == DTN_TRACE) {
+    uint16_t lost = c->trace[c->trace_head].gap + 1;
+    c->trace_head = (c->trace_head + 1) % DTN_TRACE;
+    c->trace_len--;
+    if (c->trace_len > 0) {
+      r = &c->trace[c->trace_head];
+      r->gap = r->gap + lost < 255 ? r->gap + lost : 255;
+    }
+  }
+  r = &c->trace[(c->trace_head + c->trace_len) % DTN_TRACE];
+  c->trace_len++;
+  r->time = clock_time();
+  r->epacketid = epacketid;
+  r->num_copies = num_copies;
+  rimeaddr_copy(&(r->esender), esender);
+  rimeaddr_copy(&(r->peer), peer ? peer : &rimeaddr_null);
+  r->event = event;
+  r->gap = 0;
 }
-/*---------------------------------------------------------------------------*/
+#endif /* DTN_TRACE */
+/*-LOCAL FUNCTIONS-----------------------------------------------------------*/
 struct dtn_hdr *
 dtn_buf_ptr(void)
 {
-  struct dtn_hdr *hdrptr;
-  if (packetbuf_hdrlen() == sizeof(struct dtn_hdr)) {
-    hdrptr = (struct dtn_hdr *)packetbuf_hdrptr();
-  } else {
-    hdrptr = (struct dtn_hdr *)packetbuf_dataptr();
-  }
-  return hdrptr;
+  return &dtn_buf_hdr;
+}
+/*-HEADER FORMAT-------------------------------------------------------------*/
+uint8_t *
+dtn_put16(uint8_t *p, uint16_t v)
+{
+  *p++ = v >> 8;
+  *p++ = v & 0xff;
+  return p;
 }
 /*---------------------------------------------------------------------------*/
-void
-dtn_queue_spray(void *ptr)
+uint16_t
+dtn_get16(const uint8_t *p)
 {
-  struct dtn_conn *c = (struct dtn_conn *)ptr;
-  IMPT("dtn_queue_spray: Spraying, queue length: %d\n", packetqueue_len(c->q));
-  
-  if (packetqueue_len(c->q) <= 0) {
-    IMPT("dtn_queue_spray: Empty packetqueue, nothing to spray, stopped.\n");
-    return;
-  }
-  
-  struct packetqueue_item *q_item;
-  for (q_item = packetqueue_first(c->q); q_item; q_item = q_item->next) {
-    if (q_item->ptr != DTN_READY) {
-      INFO("dtn_queue_spray: packet still pending, skip.\n");
-      continue;
+  return (uint16_t)p[0] << 8 | p[1];
+}
+/*---------------------------------------------------------------------------*/
+/* Write hdr to buf in the given format, return its length, 0 if it can't. */
+uint8_t
+dtn_hdr_encode(const struct dtn_hdr *hdr, uint8_t version, uint8_t *buf)
+{
+  uint8_t *p = buf + 2;
+#if DTN_HDR_COMPAT
+  if (version == DTN_HDR_RAW) {
+    struct dtn_hdr_raw raw;
+    if (hdr->flags & (DTN_FLAG_FRAG | DTN_FLAG_GROUP)) {
+      return 0; // version 1 has no room for them
     }
-    struct dtn_hdr *qbufdata = (struct dtn_hdr *)
-                               queuebuf_dataptr(packetqueue_queuebuf(q_item));
-    if (qbufdata == NULL) continue;
-    if (qbufdata->num_copies == 0) continue;
-    packetbuf_clear();
-    queuebuf_to_packetbuf(packetqueue_queuebuf(q_item));
-    print_packetbuf("dtn_queue_spray");
-    dtn_delay();
-    broadcast_send(&c->spray_c);
-    CSVLOG_PACKBUF("spray");
-    INFO("dtn_queue_spray: broadcast Spray sent.\n");
+    memset(&raw, 0, sizeof(raw));
+    raw.version = DTN_HDR_RAW_VERSION;
+    raw.magic[0] = DTN_MAGIC;
+    raw.magic[1] = DTN_MAGIC_BUNDLE;
+    raw.num_copies = hdr->num_copies;
+    rimeaddr_copy(&raw.esender, &(hdr->esender));
+    rimeaddr_copy(&raw.ereceiver, &(hdr->ereceiver));
+    raw.epacketid = hdr->epacketid;
+    memcpy(buf, &raw, sizeof(raw));
+    return sizeof(raw);
   }
-  
-  INFO("dtn_queue_spray: Paused spraying.\n");
-  if (ctimer_expired(&c->spray_ct)){
-    ctimer_set(&c->spray_ct,
-               DTN_SPRAY_DELAY * CLOCK_SECOND,
-               dtn_queue_spray, (void *)c);
-    INFO("dtn_queue_spray: Timer started.\n");
+#endif
+  buf[0] = DTN_HDR_PACKED << 5 | (hdr->priority & 0x03) << 3;
+  buf[1] = hdr->num_copies;
+  memcpy(p, &(hdr->esender), RIMEADDR_SIZE);
+  p += RIMEADDR_SIZE;
+  memcpy(p, &(hdr->ereceiver), RIMEADDR_SIZE);
+  p += RIMEADDR_SIZE;
+  p = dtn_put16(p, hdr->epacketid);
+  if (hdr->lifetime != 0) {
+    buf[0] |= DTN_HDR_LIFETIME;
+    p = dtn_put16(p, hdr->lifetime);
+  }
+  if (hdr->encounter != DTN_ENCOUNTER_NEVER) {
+    buf[0] |= DTN_HDR_ENCOUNTER;
+    p = dtn_put16(p, hdr->encounter);
   }
+  if (hdr->flags != 0) {
+    buf[0] |= DTN_HDR_FLAGS;
+    *p++ = hdr->flags;
+  }
+  if (hdr->flags & DTN_FLAG_FRAG) {
+    *p++ = hdr->frag_index;
+    *p++ = hdr->frag_count;
+  }
+  if (hdr->flags & DTN_FLAG_GROUP) {
+    *p++ = hdr->members;
+  }
+#if DTN_CONGESTION
+  if (hdr->flags & DTN_FLAG_LOAD) {
+    *p++ = hdr->room;
+    *p++ = hdr->load;
+  }
+#endif
+  return p - buf;
 }
 /*---------------------------------------------------------------------------*/
-struct packetqueue_item *
-dtn_queue_find(struct dtn_conn *c)
+/* Read the header at the start of buf, return its length, 0 if invalid. */
+uint8_t
+dtn_hdr_decode(struct dtn_hdr *hdr, const uint8_t *buf, uint16_t len)
 {
-  struct dtn_hdr *bufdata = dtn_buf_ptr();
-  struct packetqueue_item *q_item;
-  for (q_item = packetqueue_first(c->q); q_item; q_item = q_item->next) {
-    struct dtn_hdr *qbufdata = (struct dtn_hdr *)
-                               queuebuf_dataptr(packetqueue_queuebuf(q_item));
-    if (qbufdata == NULL) continue;
-    if (rimeaddr_cmp(&(bufdata->esender), &(qbufdata->esender))
-        && bufdata->epacketid == qbufdata->epacketid) {
-      return q_item;
+  const uint8_t *p = buf + 2;
+  uint8_t need = 2 * RIMEADDR_SIZE + 4;
+  if (len < need) return 0;
+#if DTN_HDR_COMPAT
+  if (buf[0] >> 5 == DTN_HDR_RAW) {
+    struct dtn_hdr_raw raw;
+    if (len < sizeof(raw)) return 0;
+    memcpy(&raw, buf, sizeof(raw));
+    if (raw.version != DTN_HDR_RAW_VERSION || raw.magic[0] != DTN_MAGIC
+        || raw.magic[1] != DTN_MAGIC_BUNDLE) {
+      return 0;
     }
+    hdr->version = DTN_HDR_RAW;
+    hdr->num_copies = raw.num_copies;
+    rimeaddr_copy(&(hdr->esender), &raw.esender);
+    rimeaddr_copy(&(hdr->ereceiver), &raw.ereceiver);
+    hdr->epacketid = raw.epacketid;
+    hdr->lifetime = DTN_MAX_LIFETIME; // what version 1 nodes queue for
+    hdr->priority = DTN_PRIORITY_NORMAL;
+    hdr->flags = 0;
+    hdr->encounter = DTN_ENCOUNTER_NEVER;
+    hdr->frag_index = hdr->frag_count = hdr->members = 0;
+#if DTN_CONGESTION
+    hdr->room = DTN_ROOM_UNKNOWN;
+#endif
+    return sizeof(raw);
   }
-  return NULL;
+#endif
+  if (buf[0] >> 5 != DTN_HDR_PACKED) return 0;
+  need += ((buf[0] & DTN_HDR_LIFETIME) ? 2 : 0)
+          + ((buf[0] & DTN_HDR_ENCOUNTER) ? 2 : 0)
+          + ((buf[0] & DTN_HDR_FLAGS) ? 1 : 0);
+  if (len < need) return 0;
+  hdr->version = DTN_HDR_PACKED;
+  hdr->priority = (buf[0] >> 3) & 0x03;
+  hdr->num_copies = buf[1];
+  memcpy(&(hdr->esender), p, RIMEADDR_SIZE);
+  p += RIMEADDR_SIZE;
+  memcpy(&(hdr->ereceiver), p, RIMEADDR_SIZE);
+  p += RIMEADDR_SIZE;
+  hdr->epacketid = dtn_get16(p);
+  p += 2;
+  hdr->lifetime = 0;
+  if (buf[0] & DTN_HDR_LIFETIME) {
+    hdr->lifetime = dtn_get16(p);
+    p += 2;
+  }
+  hdr->encounter = DTN_ENCOUNTER_NEVER;
+  if (buf[0] & DTN_HDR_ENCOUNTER) {
+    hdr->encounter = dtn_get16(p);
+    p += 2;
+  }
+  hdr->flags = (buf[0] & DTN_HDR_FLAGS) ? *p++ : 0;
+  hdr->frag_index = hdr->frag_count = 0;
+  if (hdr->flags & DTN_FLAG_FRAG) {
+    need += 2;
+    if (len < need) return 0;
+    hdr->frag_index = p[0];
+    hdr->frag_count = p[1];
+    p += 2;
+  }
+  hdr->members = 0;
+  if (hdr->flags & DTN_FLAG_GROUP) {
+    need += 1;
+    if (len < need) return 0;
+    hdr->members = *p++;
+  }
+#if DTN_CONGESTION
+  hdr->room = DTN_ROOM_UNKNOWN;
+#endif
+  if (hdr->flags & DTN_FLAG_LOAD) { // about the sender, never stored
+    need += 2;
+    if (len < need) return 0;
+#if DTN_CONGESTION
+    hdr->room = p[0];
+    hdr->load = p[1];
+#endif
+    hdr->flags &= ~DTN_FLAG_LOAD;
+  }
+  return need;
 }
 /*---------------------------------------------------------------------------*/
+/* Decode the header of the message in the packet buffer and strip it off. */
 int
-dtn_valid_hdr(void)
+dtn_buf_decode(void)
 {
-  struct dtn_hdr *bufdata = dtn_buf_ptr();
-  if (bufdata->version == DTN_VERSION
-      && bufdata->magic[0] == 'S'
-      && bufdata->magic[1] == 'W') {
-    return 1;
-  } else {
-    print_packetbuf("dtn_valid_hdr");
-    IMPT("dtn_valid_hdr: packet invalid.\n");
-    return 0;
+  uint8_t len = dtn_hdr_decode(&dtn_buf_hdr, packetbuf_dataptr(),
+                               packetbuf_datalen());
+  return len > 0 && packetbuf_hdrreduce(len);
+}
+/*---------------------------------------------------------------------------*/
+/* Put the header of dtn_buf_ptr() in front of the message, as version. */
+int
+dtn_buf_encode(uint8_t version)
+{
+  uint8_t buf[DTN_HDR_MAX_LEN];
+  uint8_t len = dtn_hdr_encode(&dtn_buf_hdr, version, buf);
+  if (len == 0 || !packetbuf_hdralloc(len)) return 0;
+  memcpy(packetbuf_hdrptr(), buf, len);
+  return 1;
+}
+/*-BUNDLE STORE--------------------------------------------------------------*/
+uint16_t
+dtn_store_hash(struct dtn_store *s, const rimeaddr_t *esender,
+               uint16_t epacketid)
+{
+  uint16_t h = epacketid;
+  uint8_t i;
+  for (i = 0; i < RIMEADDR_SIZE; i++) {
+    h = h * 31 + esender->u8[i];
   }
+  return h % s->index_size;
 }
-/*-SPRAY---------------------------------------------------------------------*/
+/*---------------------------------------------------------------------------*/
+int
+dtn_store_is_ready(struct dtn_store *s, struct dtn_bundle *b)
+{
+  return b->rprev != NULL || s->ready == b;
+}
+/*---------------------------------------------------------------------------*/
+/* Ticks until b expires, 0 if it has. */
+clock_time_t
+dtn_bundle_ttl(struct dtn_bundle *b)
+{
+  return timer_expired(&b->lifetime) ? 0 : timer_remaining(&b->lifetime);
+}
+/*---------------------------------------------------------------------------*/
+/* Whether a is to be sprayed before b. */
+int
+dtn_store_before(struct dtn_store *s, struct dtn_bundle *a,
+                 struct dtn_bundle *b)
+{
+  if (a->priority != b->priority) {
+    return a->priority > b->priority;
+  }
+  switch (s->order) {
+  case DTN_ORDER_MOST_COPIES:
+    return a->num_copies > b->num_copies;
+  case DTN_ORDER_NEAREST_EXPIRY:
+    return dtn_bundle_ttl(a) < dtn_bundle_ttl(b);
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+/* Insert b in the ready list, after the bundles not sprayed after it. */
 void
-dtn_spray_recv(struct broadcast_conn *b_c, const rimeaddr_t *from)
+dtn_store_link(struct dtn_store *s, struct dtn_bundle *b)
 {
-  INFO("dtn_spray_recv: broadcast received from %02x:%02x.\n",
-       from->u8[1], from->u8[0]);
-  if (!dtn_valid_hdr()) return;
-  struct dtn_conn *c = (struct dtn_conn *)
-                       ((void *)b_c - offsetof(struct dtn_conn, spray_c));
-  print_packetbuf("dtn_spray_recv");
-  struct dtn_hdr *bufdata = dtn_buf_ptr();
-  struct dtn_hdr recv_hdr;
-  memcpy(&recv_hdr, bufdata, sizeof (struct dtn_hdr));
-  
-  if (rimeaddr_cmp(&(recv_hdr.esender), &rimeaddr_node_addr)) { // from me
-    INFO("dtn_spray_recv: Spray message is from me, do nothing.\n");
-    return;
+  struct dtn_bundle *p = s->ready_tail;
+  while (p && dtn_store_before(s, b, p)) {
+    p = p->rprev;
   }
-  
-  if (rimeaddr_cmp(&(recv_hdr.ereceiver), &rimeaddr_node_addr)) { // to me
-    dtn_delay();
-    unicast_send(&c->request_c, from);
-    CSVLOG_PACKBUF("request");
-    IMPT("dtn_spray_recv: unicast Request confirmation sent.\n");
-    IMPT("dtn_spray_recv: Spray message is to me, invoking callback.\n");
-    packetbuf_hdrreduce(sizeof(struct dtn_hdr));
-    c->cb->recv(c, &(recv_hdr.esender), recv_hdr.epacketid);
-    return;
+  b->rprev = p;
+  b->rnext = p ? p->rnext : s->ready;
+  if (b->rnext) {
+    b->rnext->rprev = b;
+  } else {
+    s->ready_tail = b;
   }
-  
-  if (recv_hdr.num_copies == 1) { // not to me and only one copy
-    INFO("dtn_spray_recv: Not to me and L == 1, do nothing.\n");
-    return;
+  if (p) {
+    p->rnext = b;
+  } else {
+    s->ready = b;
   }
-  
-  struct packetqueue_item * item;
-  if (item = dtn_queue_find(c)) { // found in the queue
-    if (item->ptr == DTN_READY) {
-      INFO("dtn_spray_recv: Spray in the queue and ready, do nothing.\n");
-    } else { // still pending
-      dtn_delay();
-      unicast_send(&c->request_c, from);
-      CSVLOG_PACKBUF("request");
-      IMPT("dtn_spray_recv: Spray in queue but pending, Request sent to ");
-      IMPTADDR(from);
-      IMPT(".\n");
-    }
-    return;
+}
+/*---------------------------------------------------------------------------*/
+void
+dtn_store_unlink(struct dtn_store *s, struct dtn_bundle *b)
+{
+  if (s->cursor == b) {
+    s->cursor = b->rnext;
   }
-  
-  // not in the queue
-  bufdata->num_copies = 0;
-  if (packetqueue_enqueue_packetbuf(c->q,
-                                    DTN_MAX_LIFETIME * CLOCK_SECOND,
-                                    DTN_PENDING)) {
-    INFO("dtn_spray_recv: Enqueued (pending) successfully.\n");
-    dtn_delay();
-    unicast_send(&c->request_c, from);
-    CSVLOG_PACKBUF("request");
-    IMPT("dtn_spray_recv: unicast Request sent to ");
-    IMPTADDR(from);
-    IMPT(".\n");
+  if (b->rprev) {
+    b->rprev->rnext = b->rnext;
   } else {
-    IMPT("dtn_spray_recv: Failed to enqueue.\n");
+    s->ready = b->rnext;
+  }
+  if (b->rnext) {
+    b->rnext->rprev = b->rprev;
+  } else {
+    s->ready_tail = b->rprev;
   }
+  b->rprev = b->rnext = NULL;
 }
 /*---------------------------------------------------------------------------*/
-const struct broadcast_callbacks dtn_spray_call = {dtn_spray_recv};
-/*-REQUEST-------------------------------------------------------------------*/
+/* Keep b in the ready list, in order, if and only if it can be sprayed. */
 void
-dtn_request_recv(struct unicast_conn *u_c, const rimeaddr_t *from)
+dtn_store_relink(struct dtn_store *s, struct dtn_bundle *b)
 {
-  INFO("dtn_request_recv: unicast received from %02x:%02x\n",
-       from->u8[1], from->u8[0]);
-  if (!dtn_valid_hdr()) return;
-  struct dtn_conn *c = (struct dtn_conn *)
-                       ((void *)u_c - offsetof(struct dtn_conn, request_c));
-  print_packetbuf("dtn_request_recv");
-  
-  struct packetqueue_item * q_item;
-  if (!(q_item = dtn_queue_find(c))) {
-    IMPT("dtn_request_recv: Request not in the queue, do nothing.\n");
-    return;
+  int sprayable = b->state == DTN_READY && b->num_copies > 0;
+  if (dtn_store_is_ready(s, b)) {
+    if (sprayable && !(b->rprev && dtn_store_before(s, b, b->rprev))
+        && !(b->rnext && dtn_store_before(s, b->rnext, b))) {
+      return;
+    }
+    dtn_store_unlink(s, b);
   }
-  if (q_item->ptr != DTN_READY) {
-    IMPT("dtn_request_recv: Request in queue, but pending, do nothing.\n");
-    return;
+  if (sprayable) {
+    dtn_store_link(s, b);
   }
-  INFO("dtn_request_recv: Request found in the queue.\n");
-  struct dtn_hdr *qbufdata = (struct dtn_hdr *)
-                             queuebuf_dataptr(packetqueue_queuebuf(q_item));
-  if (rimeaddr_cmp(&(qbufdata->ereceiver), from)) {
-    qbufdata->num_copies = 0;
-    IMPT("dtn_request_recv: receiver got message, set L to 0.\n");
-    return;
+}
+/*---------------------------------------------------------------------------*/
+/* Index b, that expires in lifetime seconds. */
+void
+dtn_store_index(struct dtn_store *s, struct dtn_bundle *b, uint16_t lifetime)
+{
+  uint16_t h = dtn_store_hash(s, &(b->esender), b->epacketid);
+  b->hnext = s->index[h];
+  s->index[h] = b;
+  s->len++;
+#if DTN_STATS
+  if (s->len > DTN_STORE_CONN(s)->stats.queue_hwm) {
+    DTN_STORE_CONN(s)->stats.queue_hwm = s->len;
   }
-  if ((qbufdata->num_copies == 1)
-      && !rimeaddr_cmp(from, &(qbufdata->ereceiver))) {
-    IMPT("dtn_request_recv: L == 1, and from != ereceiver, do nothing.\n");
-    return;
+#endif
+  if (lifetime > DTN_MAX_LIFETIME) {
+    lifetime = DTN_MAX_LIFETIME;
   }
-  if (qbufdata->num_copies == 0) {
-    IMPT("dtn_request_recv: L == 0, do nothing.\n");
-    return;
+  timer_set(&b->lifetime, (clock_time_t)lifetime * CLOCK_SECOND);
+  dtn_store_relink(s, b);
+}
+/*---------------------------------------------------------------------------*/
+#if DTN_STORE_CFS
+/* Write the state and L of b to its slot. */
+void
+dtn_store_sync(struct dtn_store *s, struct dtn_bundle *b)
+{
+  struct dtn_store_rec rec;
+  rec.magic = DTN_MAGIC;
+  rec.state = b->state;
+  rec.num_copies = b->num_copies;
+  cfs_seek(s->fd, DTN_STORE_SLOT(b - s->bundles), CFS_SEEK_SET);
+  cfs_write(s->fd, &rec, offsetof(struct dtn_store_rec, len));
+}
+/*---------------------------------------------------------------------------*/
+/* Index the bundle in the slot of b, if there is one. */
+int
+dtn_store_load(struct dtn_store *s, struct dtn_bundle *b)
+{
+  struct dtn_store_rec rec;
+  struct dtn_hdr hdr;
+  uint8_t buf[DTN_HDR_MAX_LEN];
+  cfs_seek(s->fd, DTN_STORE_SLOT(b - s->bundles), CFS_SEEK_SET);
+  uint16_t len;
+  if (cfs_read(s->fd, &rec, sizeof(rec)) != sizeof(rec)
+      || rec.magic != DTN_MAGIC || rec.state == DTN_FREE
+      || rec.len > PACKETBUF_SIZE) {
+    return 0;
   }
-  if (c->handoff_qb != NULL) {
-    IMPT("dtn_request_recv: Another HandOff in progress, do nothing.\n");
-    return;
+  len = rec.len < sizeof(buf) ? rec.len : sizeof(buf);
+  if (cfs_read(s->fd, buf, len) != len || !dtn_hdr_decode(&hdr, buf, len)) {
+    return 0;
   }
-  c->handoff_qb = (struct dtn_hdr *)
-                  queuebuf_dataptr(packetqueue_queuebuf(q_item));
-  memcpy(&(c->handoff_hdr), c->handoff_qb, sizeof(struct dtn_hdr));
-  queuebuf_to_packetbuf(packetqueue_queuebuf(q_item));
-  struct dtn_hdr *bufdata = dtn_buf_ptr();
-  bufdata->num_copies /= 2;
-  dtn_delay();
-  runicast_send(&c->handoff_c, from, DTN_RTX);
-  CSVLOG_PACKBUF("handoff");
-  IMPT("dtn_request_recv: runicast HandOff(L=%d) sending.\n",
-       bufdata->num_copies);
+  rimeaddr_copy(&(b->esender), &(hdr.esender));
+  rimeaddr_copy(&(b->ereceiver), &(hdr.ereceiver));
+  b->epacketid = hdr.epacketid;
+  b->num_copies = rec.num_copies;
+  b->state = rec.state;
+  b->priority = hdr.priority;
+#if DTN_GROUPS
+  b->members = hdr.members;
+  b->covered_len = 0;
+#endif
+  dtn_store_index(s, b, hdr.lifetime);
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+/* The next sequence number of ours, kept so that it survives reboots. */
+uint16_t
+dtn_store_seqno(struct dtn_store *s)
+{
+  uint16_t seqno = 0;
+  cfs_seek(s->fd, 0, CFS_SEEK_SET);
+  cfs_read(s->fd, &seqno, sizeof(seqno));
+  return seqno;
 }
 /*---------------------------------------------------------------------------*/
-const struct unicast_callbacks dtn_request_call = {dtn_request_recv};
-/*-HANDOFF-------------------------------------------------------------------*/
 void
-dtn_handoff_recv(struct runicast_conn *r_c, const rimeaddr_t *from,
-                 uint8_t seqno)
+dtn_store_set_seqno(struct dtn_store *s, uint16_t seqno)
 {
-  INFO("dtn_handoff_recv: runicast received from %02x:%02x, seqno %d\n",
-       from->u8[1], from->u8[0], seqno);
-  if (!dtn_valid_hdr()) return;
-  struct dtn_conn *c = (struct dtn_conn *)
-                       ((void *)r_c - offsetof(struct dtn_conn, handoff_c));
-  struct packetqueue_item * q_item;
-  if (!(q_item = dtn_queue_find(c))) { // not found in the queue
-    IMPT("dtn_handoff_recv: HandOff not in the queue, do nothing.\n");
-    return;
+  cfs_seek(s->fd, 0, CFS_SEEK_SET);
+  cfs_write(s->fd, &seqno, sizeof(seqno));
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Name the store file of the connection on channel into file, of
+ * sizeof(DTN_STORE_FILE) + 6 bytes: DTN_STORE_FILE, a dot and the channel.
+ */
+void
+dtn_store_file(char *file, uint16_t channel)
+{
+  uint16_t d = 10000;
+  memcpy(file, DTN_STORE_FILE ".", sizeof(DTN_STORE_FILE));
+  file += sizeof(DTN_STORE_FILE);
+  while (d > 1 && channel < d) d /= 10;
+  for (; d > 0; d /= 10) {
+    *file++ = '0' + channel / d % 10;
   }
-  INFO("dtn_handoff_recv: HandOff found in the queue.\n");
-  struct dtn_hdr *qbufdata = (struct dtn_hdr *)
-                             queuebuf_dataptr(packetqueue_queuebuf(q_item));
-  struct dtn_hdr *bufdata = dtn_buf_ptr();
-  qbufdata->num_copies += bufdata->num_copies;
-  if (qbufdata->num_copies > DTN_L_COPIES) {
-    qbufdata->num_copies = DTN_L_COPIES;
+  *file = '\0';
+}
+#endif /* DTN_STORE_CFS */
+/*---------------------------------------------------------------------------*/
+void
+dtn_store_init(struct dtn_store *s, struct dtn_pool *pool)
+{
+  uint16_t i;
+  s->bundles = pool->bundles;
+  s->size = pool->size;
+  s->index = pool->index;
+  s->index_size = pool->index_size;
+  for (i = 0; i < s->index_size; i++) {
+    s->index[i] = NULL;
+  }
+  s->free = NULL;
+  s->ready = s->ready_tail = s->cursor = NULL;
+  s->len = 0;
+  s->drop = DTN_DROP_POLICY;
+  s->order = DTN_SPRAY_ORDER;
+#if DTN_STORE_CFS
+  s->fd = cfs_open(pool->file, CFS_READ | CFS_WRITE);
+  if (s->fd < 0) {
+    IMPT("dtn_store_init: Failed to open the store file.\n");
+  }
+#endif
+  for (i = s->size; i-- > 0;) {
+    struct dtn_bundle *b = &s->bundles[i];
+    b->state = DTN_FREE;
+    b->rprev = b->rnext = NULL;
+#if DTN_STORE_CFS
+    if (s->fd >= 0 && dtn_store_load(s, b)) continue;
+#else
+    b->qb = NULL;
+#endif
+    b->hnext = s->free;
+    s->free = b;
   }
-  q_item->ptr = DTN_READY;
-  INFO("dtn_handoff_recv: packet state set to ready.\n");
-  IMPT("dtn_handoff_recv: HandOff(L=%d) received and processed.\n",
-       bufdata->num_copies);
-  dtn_queue_spray((void *)c);
 }
 /*---------------------------------------------------------------------------*/
+/* Update the ready list after a change of state or L, and persist it. */
 void
-dtn_handoff_sent(struct runicast_conn *r_c, const rimeaddr_t *to,
-                 uint8_t retransmissions)
+dtn_store_update(struct dtn_store *s, struct dtn_bundle *b)
 {
-  INFO("dtn_handoff_sent: runicast sent to %02x:%02x, retried %d\n",
-       to->u8[1], to->u8[0], retransmissions);
-  struct dtn_conn *c = (struct dtn_conn *)
-                       ((void *)r_c - offsetof(struct dtn_conn, handoff_c));
-  if (rimeaddr_cmp(&(c->handoff_qb->esender), &(c->handoff_hdr.esender))
-      && c->handoff_qb->epacketid == c->handoff_hdr.epacketid) {
-    int sent_copies = c->handoff_qb->num_copies / 2;
-    c->handoff_qb->num_copies = c->handoff_qb->num_copies - sent_copies;
-    IMPT("dtn_handoff_sent: HandOff(L=%d) processed.\n", sent_copies);
-  } else {
-    IMPT("dtn_handoff_sent: not matched (expired), HandOff not processed.\n");
+  dtn_store_relink(s, b);
+#if DTN_STORE_CFS
+  dtn_store_sync(s, b);
+#endif
+}
+/*---------------------------------------------------------------------------*/
+void
+dtn_store_remove(struct dtn_store *s, struct dtn_bundle *b)
+{
+  struct dtn_bundle **p;
+  b->state = DTN_FREE;
+  dtn_store_update(s, b);
+  for (p = &s->index[dtn_store_hash(s, &b->esender, b->epacketid)];
+       *p; p = &(*p)->hnext) {
+    if (*p == b) {
+      *p = b->hnext;
+      break;
+    }
   }
-  c->handoff_qb = NULL;
+#if !DTN_STORE_CFS
+  queuebuf_free(b->qb);
+  b->qb = NULL;
+#endif
+  b->hnext = s->free;
+  s->free = b;
+  s->len--;
 }
 /*---------------------------------------------------------------------------*/
+/* Drop b, that expired. */
 void
-dtn_handoff_timedout(struct runicast_conn *r_c, const rimeaddr_t *to,
-                     uint8_t retransmissions)
+dtn_store_expire(struct dtn_store *s, struct dtn_bundle *b)
 {
-  IMPT("dtn_handoff_timedout: runicast timed out, to %02x:%02x, retried %d\n",
-       to->u8[1], to->u8[0], retransmissions);
-  struct dtn_conn *c = (struct dtn_conn *)
-                       ((void *)r_c - offsetof(struct dtn_conn, handoff_c));
-  c->handoff_qb = NULL;
-  IMPT("dtn_handoff_sent: HandOff failed.\n");
+  DTN_STAT(DTN_STORE_CONN(s), expired);
+  DTN_TRACE_EVENT(DTN_STORE_CONN(s), DTN_TRACE_EXPIRE, &(b->esender),
+                  b->epacketid, NULL, b->num_copies);
+  dtn_store_remove(s, b);
 }
 /*---------------------------------------------------------------------------*/
-const struct runicast_callbacks dtn_handoff_call = {dtn_handoff_recv,
-                                                    dtn_handoff_sent,
-                                                    dtn_handoff_timedout};
-/*-DTN CALLS-----------------------------------------------------------------*/
 void
-dtn_open(struct dtn_conn *c, uint16_t dtn_channel,
-         const struct dtn_callbacks *cb)
+dtn_store_clear(struct dtn_store *s)
 {
-  random_init(clock_time());
-  packetqueue_init(&dtn_packetqueue);
-  c->q = &dtn_packetqueue;
-  c->seqno = 0;
-  c->cb = cb;
-  c->handoff_qb = NULL;
-  broadcast_open(&c->spray_c, dtn_channel, &dtn_spray_call);
-  unicast_open(&c->request_c, dtn_channel + 1, &dtn_request_call);
-  runicast_open(&c->handoff_c, dtn_channel + 2, &dtn_handoff_call);
-  IMPT("dtn_open: DTN connection opened at channel (%d, %d, %d).\n",
-       dtn_channel, dtn_channel + 1, dtn_channel + 2);
+  uint16_t i;
+  for (i = 0; i < s->size; i++) {
+    if (s->bundles[i].state != DTN_FREE) {
+      dtn_store_remove(s, &s->bundles[i]);
+    }
+  }
 }
 /*---------------------------------------------------------------------------*/
+/* Release the store, the bundles of a CFS store stay in the file. */
 void
-dtn_close(struct dtn_conn *c)
+dtn_store_close(struct dtn_store *s)
 {
-  broadcast_close(&c->spray_c);
-  unicast_close(&c->request_c);
-  runicast_close(&c->handoff_c);
-  IMPT("dtn_close: DTN closed.");
+#if DTN_STORE_CFS
+  if (s->fd >= 0) {
+    cfs_close(s->fd);
+    s->fd = -1;
+  }
+#else
+  dtn_store_clear(s);
+#endif
+}
+/*---------------------------------------------------------------------------*/
+/* Drop every expired bundle. Walks the whole store, only used when full. */
+void
+dtn_store_purge(struct dtn_store *s)
+{
+  uint16_t i;
+  for (i = 0; i < s->size; i++) {
+    struct dtn_bundle *b = &s->bundles[i];
+    if (b->state != DTN_FREE && timer_expired(&b->lifetime)) {
+      INFO("dtn_store_purge: bundle expired, removed.\n");
+      dtn_store_expire(s, b);
+    }
+  }
 }
 /*---------------------------------------------------------------------------*/
+/* Whether a is to be dropped before b when the store is full. */
 int
-dtn_send(struct dtn_conn *c, const rimeaddr_t *to)
+dtn_store_worse(struct dtn_store *s, struct dtn_bundle *a,
+                struct dtn_bundle *b)
 {
-  if (rimeaddr_cmp(to, &rimeaddr_node_addr)) { // to me
-    IMPT("dtn_send: send to myself, invoking callback.\n");
-    c->cb->recv(c, to, c->seqno++);
-    return 1;
+  if (a->priority != b->priority) {
+    return a->priority < b->priority;
   }
-  struct dtn_hdr hdr;
-  hdr.version = DTN_VERSION;
-  hdr.magic[0] = 'S';
-  hdr.magic[1] = 'W';
-  hdr.num_copies = DTN_L_COPIES;
-  hdr.epacketid = c->seqno;
-  c->seqno++;
-  rimeaddr_copy(&hdr.ereceiver, to);
-  rimeaddr_copy(&hdr.esender, &rimeaddr_node_addr);
-  packetbuf_hdralloc(sizeof(struct dtn_hdr));
-  memcpy(packetbuf_hdrptr(), &hdr, sizeof(struct dtn_hdr));
-  print_packetbuf("dtn_send");
-  if (packetqueue_enqueue_packetbuf(c->q,
-                                    DTN_MAX_LIFETIME * CLOCK_SECOND,
-                                    DTN_READY)) {
-    INFO("dtn_send: Enqueued successfully.\n");
-    dtn_queue_spray((void *)c);
-    return 1;
-  } else {
-    IMPT("dtn_send: Failed to enqueue.\n");
-    return 0;
+  switch (s->drop) {
+  case DTN_DROP_OLDEST:
+    return (clock_time_t)(clock_time() - a->lifetime.start)
+           > (clock_time_t)(clock_time() - b->lifetime.start);
+  case DTN_DROP_MOST_COPIES:
+    return a->num_copies > b->num_copies;
+  case DTN_DROP_NEAREST_EXPIRY:
+    return dtn_bundle_ttl(a) < dtn_bundle_ttl(b);
   }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+/* Drop the bundle the drop policy values the least. */
+void
+dtn_store_evict(struct dtn_store *s)
+{
+  struct dtn_bundle *victim = NULL;
+  uint16_t i;
+  for (i = 0; i < s->size; i++) {
+    struct dtn_bundle *b = &s->bundles[i];
+    if (b->state != DTN_FREE
+        && (victim == NULL || dtn_store_worse(s, b, victim))) {
+      victim = b;
+    }
+  }
+  if (victim) {
+    IMPT("dtn_store_evict: Store full, bundle dropped.\n");
+    DTN_STAT(DTN_STORE_CONN(s), evicted);
+    DTN_TRACE_EVENT(DTN_STORE_CONN(s), DTN_TRACE_EVICT, &(victim->esender),
+                    victim->epacketid, NULL, victim->num_copies);
+    dtn_store_remove(s, victim);
+  }
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Whether a bundle received now could be stored, dropping expired ones, or
+ * by dropping another one.
+ */
+int
+dtn_store_has_room(struct dtn_store *s)
+{
+  if (s->free == NULL) {
+    dtn_store_purge(s);
+  }
+  return s->free != NULL || s->drop != DTN_DROP_NONE;
+}
+/*---------------------------------------------------------------------------*/
+void
+dtn_store_set_policy(struct dtn_store *s, uint8_t drop, uint8_t order)
+{
+  struct dtn_bundle *b, *next;
+  s->drop = drop;
+  if (order == s->order) return;
+  s->order = order;
+  b = s->ready;
+  s->ready = s->ready_tail = NULL;
+  for (; b; b = next) {
+    next = b->rnext;
+    dtn_store_link(s, b);
+  }
+}
+/*---------------------------------------------------------------------------*/
+struct dtn_bundle *
+dtn_store_find(struct dtn_store *s, const rimeaddr_t *esender,
+               uint16_t epacketid)
+{
+  struct dtn_bundle *b;
+  for (b = s->index[dtn_store_hash(s, esender, epacketid)]; b;
+       b = b->hnext) {
+    if (b->epacketid == epacketid && rimeaddr_cmp(&(b->esender), esender)) {
+      if (timer_expired(&b->lifetime)) {
+        INFO("dtn_store_find: bundle expired, removed.\n");
+        dtn_store_expire(s, b);
+        return NULL;
+      }
+      return b;
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+/* Store the message in the packet buffer as a new bundle. */
+struct dtn_bundle *
+dtn_store_add(struct dtn_store *s, uint8_t state)
+{
+  struct dtn_hdr *bufdata = dtn_buf_ptr();
+  struct dtn_bundle *b;
+  if (bufdata->lifetime == 0) {
+    INFO("dtn_store_add: bundle expired, not stored.\n");
+    DTN_STAT(DTN_STORE_CONN(s), expired);
+    DTN_TRACE_EVENT(DTN_STORE_CONN(s), DTN_TRACE_EXPIRE, &(bufdata->esender),
+                    bufdata->epacketid, NULL, bufdata->num_copies);
+    return NULL;
+  }
+  if (!dtn_store_has_room(s)) {
+    DTN_STAT(DTN_STORE_CONN(s), enqueue_failed);
+    return NULL;
+  }
+  if (s->free == NULL) {
+    dtn_store_evict(s);
+  }
+  // stored packed, whichever format it came in
+  if (!dtn_buf_encode(DTN_HDR_PACKED)) {
+    DTN_STAT(DTN_STORE_CONN(s), enqueue_failed);
+    return NULL;
+  }
+  b = s->free;
+#if DTN_STORE_CFS
+  struct dtn_store_rec rec;
+  rec.magic = DTN_MAGIC;
+  rec.state = state;
+  rec.num_copies = bufdata->num_copies;
+  rec.len = packetbuf_totlen();
+  cfs_seek(s->fd, DTN_STORE_SLOT(b - s->bundles), CFS_SEEK_SET);
+  if (s->fd < 0 || rec.len > PACKETBUF_SIZE
+      || cfs_write(s->fd, &rec, sizeof(rec)) != sizeof(rec)
+      || cfs_write(s->fd, packetbuf_hdrptr(), packetbuf_hdrlen())
+         != packetbuf_hdrlen()
+      || cfs_write(s->fd, packetbuf_dataptr(), packetbuf_datalen())
+         != packetbuf_datalen()) {
+    IMPT("dtn_store_add: Failed to write to the store file.\n");
+    DTN_STAT(DTN_STORE_CONN(s), enqueue_failed);
+    return NULL;
+  }
+#else
+  b->qb = queuebuf_new_from_packetbuf();
+  if (b->qb == NULL) {
+    DTN_STAT(DTN_STORE_CONN(s), enqueue_failed);
+    return NULL;
+  }
+#endif
+  s->free = b->hnext;
+  rimeaddr_copy(&(b->esender), &(bufdata->esender));
+  rimeaddr_copy(&(b->ereceiver), &(bufdata->ereceiver));
+  b->epacketid = bufdata->epacketid;
+  b->num_copies = bufdata->num_copies;
+  b->state = state;
+  b->priority = bufdata->priority;
+#if DTN_GROUPS
+  b->members = (bufdata->flags & DTN_FLAG_GROUP) ? bufdata->members : 0;
+  b->covered_len = 0;
+#endif
+  b->rprev = b->rnext = NULL;
+  dtn_store_index(s, b, bufdata->lifetime);
+  return b;
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Decode the stored header of the bundle into hdr, with its current L and
+ * lifetime. Returns the length of its message, -1 if it is gone. A bundle
+ * in memory is decoded where it lies in its queue buffer.
+ */
+int
+dtn_bundle_hdr(struct dtn_store *s, struct dtn_bundle *b, struct dtn_hdr *hdr)
+{
+  uint8_t hdr_len;
+  uint16_t len;
+  if (dtn_bundle_ttl(b) < CLOCK_SECOND) {
+    INFO("dtn_bundle_hdr: bundle expired, removed.\n");
+    dtn_store_expire(s, b);
+    return -1;
+  }
+#if DTN_STORE_CFS
+  struct dtn_store_rec rec;
+  uint8_t buf[DTN_HDR_MAX_LEN];
+  cfs_seek(s->fd, DTN_STORE_SLOT(b - s->bundles), CFS_SEEK_SET);
+  if (cfs_read(s->fd, &rec, sizeof(rec)) != sizeof(rec)
+      || rec.len > PACKETBUF_SIZE) {
+    IMPT("dtn_bundle_hdr: Failed to read the store file.\n");
+    return -1;
+  }
+  len = rec.len < sizeof(buf) ? rec.len : sizeof(buf);
+  if (cfs_read(s->fd, buf, len) != len) {
+    IMPT("dtn_bundle_hdr: Failed to read the store file.\n");
+    return -1;
+  }
+  hdr_len = dtn_hdr_decode(hdr, buf, len);
+  len = rec.len;
+#else
+  len = queuebuf_datalen(b->qb);
+  hdr_len = dtn_hdr_decode(hdr, queuebuf_dataptr(b->qb), len);
+#endif
+  if (hdr_len == 0) {
+    IMPT("dtn_bundle_hdr: Stored header invalid.\n");
+    return -1;
+  }
+  hdr->num_copies = b->num_copies;
+  hdr->lifetime = dtn_bundle_ttl(b) / CLOCK_SECOND;
+  return len - hdr_len;
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Copy the message of the bundle, the len bytes dtn_bundle_hdr() told, to
+ * data, straight from its queue buffer or the store file.
+ */
+int
+dtn_bundle_data(struct dtn_store *s, struct dtn_bundle *b, uint8_t *data,
+                uint16_t len)
+{
+#if DTN_STORE_CFS
+  struct dtn_store_rec rec;
+  cfs_seek(s->fd, DTN_STORE_SLOT(b - s->bundles), CFS_SEEK_SET);
+  if (cfs_read(s->fd, &rec, sizeof(rec)) != sizeof(rec) || rec.len < len
+      || rec.len > PACKETBUF_SIZE) {
+    IMPT("dtn_bundle_data: Failed to read the store file.\n");
+    return 0;
+  }
+  cfs_seek(s->fd, DTN_STORE_SLOT(b - s->bundles) + sizeof(rec) + rec.len
+                  - len, CFS_SEEK_SET);
+  if (cfs_read(s->fd, data, len) != len) {
+    IMPT("dtn_bundle_data: Failed to read the store file.\n");
+    return 0;
+  }
+#else
+  uint16_t total = queuebuf_datalen(b->qb);
+  if (total < len) return 0;
+  memcpy(data, (uint8_t *)queuebuf_dataptr(b->qb) + total - len, len);
+#endif
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+/* Load the bundle into the packet buffer, with its current L and lifetime. */
+int
+dtn_bundle_to_packetbuf(struct dtn_store *s, struct dtn_bundle *b)
+{
+  int len = dtn_bundle_hdr(s, b, dtn_buf_ptr());
+  if (len < 0) return 0;
+  packetbuf_clear();
+  if (!dtn_bundle_data(s, b, packetbuf_dataptr(), len)) return 0;
+  packetbuf_set_datalen(len);
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+struct dtn_bundle *
+dtn_queue_find(struct dtn_conn *c)
+{
+  struct dtn_hdr *bufdata = dtn_buf_ptr();
+  return dtn_store_find(&c->store, &(bufdata->esender), bufdata->epacketid);
+}
+/*-SUMMARY VECTORS-----------------------------------------------------------*/
+#if DTN_SUMMARY_VECTORS
+uint32_t
+dtn_sv_hash(const rimeaddr_t *esender, uint16_t epacketid)
+{
+  uint32_t h = 2166136261UL;
+  uint8_t i;
+  for (i = 0; i < RIMEADDR_SIZE; i++) {
+    h = (h ^ esender->u8[i]) * 16777619UL;
+  }
+  h = (h ^ (epacketid & 0xff)) * 16777619UL;
+  h = (h ^ (epacketid >> 8)) * 16777619UL;
+  return h;
+}
+/*---------------------------------------------------------------------------*/
+void
+dtn_sv_add(uint8_t *bits, const rimeaddr_t *esender, uint16_t epacketid)
+{
+  uint32_t h = dtn_sv_hash(esender, epacketid);
+  uint16_t h1 = h & 0xffff, h2 = (h >> 16) | 1;
+  uint8_t i;
+  for (i = 0; i < DTN_SV_HASHES; i++) {
+    uint16_t bit = (uint16_t)(h1 + i * h2) % DTN_SV_BITS;
+    bits[bit / 8] |= 1 << (bit % 8);
+  }
+}
+/*---------------------------------------------------------------------------*/
+int
+dtn_sv_contains(const uint8_t *bits, const rimeaddr_t *esender,
+                uint16_t epacketid)
+{
+  uint32_t h = dtn_sv_hash(esender, epacketid);
+  uint16_t h1 = h & 0xffff, h2 = (h >> 16) | 1;
+  uint8_t i;
+  for (i = 0; i < DTN_SV_HASHES; i++) {
+    uint16_t bit = (uint16_t)(h1 + i * h2) % DTN_SV_BITS;
+    if (!(bits[bit / 8] & (1 << (bit % 8)))) return 0;
+  }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+/* Remember a delivery, so neighbours stop offering the bundle to us. */
+void
+dtn_sv_delivered(struct dtn_conn *c, const rimeaddr_t *esender,
+                 uint16_t epacketid)
+{
+  if (c->sv_delivered_count >= DTN_SV_BITS / 16) { // too full to be useful
+    memset(c->sv_delivered, 0, sizeof(c->sv_delivered));
+    c->sv_delivered_count = 0;
+  }
+  dtn_sv_add(c->sv_delivered, esender, epacketid);
+  c->sv_delivered_count++;
+}
+/*---------------------------------------------------------------------------*/
+void
+dtn_sv_send(struct dtn_conn *c)
+{
+  uint16_t i, held = c->sv_delivered_count;
+  packetbuf_clear();
+  struct dtn_sv_hdr *sv = (struct dtn_sv_hdr *)packetbuf_dataptr();
+  sv->version = DTN_VERSION;
+  sv->magic[0] = DTN_MAGIC;
+  sv->magic[1] = DTN_MAGIC_SV;
+  memcpy(sv->bits, c->sv_delivered, sizeof(sv->bits));
+  for (i = 0; i < c->store.size; i++) {
+    struct dtn_bundle *b = &c->store.bundles[i];
+    if (b->state == DTN_READY) {
+      dtn_sv_add(sv->bits, &(b->esender), b->epacketid);
+      held++;
+    }
+  }
+  // an empty vector suppresses nothing, neighbours spray to us anyway
+  if (held == 0) return;
+  packetbuf_set_datalen(sizeof(struct dtn_sv_hdr));
+  c->sv_sent = clock_time();
+  broadcast_send(&c->spray_c);
+  INFO("dtn_sv_send: broadcast summary vector sent.\n");
+}
+/*---------------------------------------------------------------------------*/
+/* Send our summary vector unless it was sent less than interval ago. */
+void
+dtn_sv_send_after(struct dtn_conn *c, clock_time_t interval)
+{
+  if ((clock_time_t)(clock_time() - c->sv_sent) >= interval) {
+    dtn_tx_add(c, DTN_TX_SV, NULL);
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Whether every neighbour we have a fresh summary vector of holds b. */
+int
+dtn_sv_covered(struct dtn_conn *c, struct dtn_bundle *b)
+{
+  uint8_t i, fresh = 0;
+  for (i = 0; i < DTN_SV_NEIGHBOURS; i++) {
+    struct dtn_sv_neighbour *n = &c->sv_nbr[i];
+    if (rimeaddr_cmp(&(n->addr), &rimeaddr_null)
+        || timer_expired(&(n->lifetime))) {
+      continue;
+    }
+    if (!dtn_sv_contains(n->bits, &(b->esender), b->epacketid)) return 0;
+    fresh++;
+  }
+  return fresh > 0;
+}
+/*---------------------------------------------------------------------------*/
+int
+dtn_valid_sv(void)
+{
+  struct dtn_sv_hdr *sv = (struct dtn_sv_hdr *)packetbuf_dataptr();
+  return packetbuf_datalen() >= sizeof(struct dtn_sv_hdr)
+         && sv->version == DTN_VERSION
+         && sv->magic[0] == DTN_MAGIC
+         && sv->magic[1] == DTN_MAGIC_SV;
+}
+/*---------------------------------------------------------------------------*/
+/* The summary vector entry of a neighbour, or the one to replace with it. */
+struct dtn_sv_neighbour *
+dtn_sv_neighbour(struct dtn_conn *c, const rimeaddr_t *from)
+{
+  struct dtn_sv_neighbour *n = NULL;
+  uint8_t i;
+  for (i = 0; i < DTN_SV_NEIGHBOURS; i++) {
+    struct dtn_sv_neighbour *e = &c->sv_nbr[i];
+    if (rimeaddr_cmp(&(e->addr), from)) {
+      n = e;
+      break;
+    }
+    // otherwise reuse an unused or expired entry, or else the stalest one
+    if (n != NULL && (rimeaddr_cmp(&(n->addr), &rimeaddr_null)
+                      || timer_expired(&(n->lifetime)))) {
+      continue;
+    }
+    if (n == NULL || rimeaddr_cmp(&(e->addr), &rimeaddr_null)
+        || timer_expired(&(e->lifetime))
+        || timer_remaining(&(e->lifetime)) < timer_remaining(&(n->lifetime))) {
+      n = e;
+    }
+  }
+  return n;
+}
+/*---------------------------------------------------------------------------*/
+/* A neighbour asked for b, so it must not count as holding it. */
+void
+dtn_sv_lacks(struct dtn_conn *c, const rimeaddr_t *from, struct dtn_bundle *b)
+{
+  struct dtn_sv_neighbour *n = dtn_sv_neighbour(c, from);
+  if (!rimeaddr_cmp(&(n->addr), from) || timer_expired(&(n->lifetime))) {
+    rimeaddr_copy(&(n->addr), from);
+    memset(n->bits, 0, sizeof(n->bits));
+    timer_set(&(n->lifetime), DTN_SV_LIFETIME * CLOCK_SECOND);
+  } else if (dtn_sv_contains(n->bits, &(b->esender), b->epacketid)) {
+    // a false positive or a stale vector, stop trusting it
+    memset(n->bits, 0, sizeof(n->bits));
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+dtn_sv_recv(struct dtn_conn *c, const rimeaddr_t *from)
+{
+  struct dtn_sv_hdr *sv = (struct dtn_sv_hdr *)packetbuf_dataptr();
+  struct dtn_sv_neighbour *n = dtn_sv_neighbour(c, from);
+  rimeaddr_copy(&(n->addr), from);
+  memcpy(n->bits, sv->bits, sizeof(n->bits));
+  timer_set(&(n->lifetime), DTN_SV_LIFETIME * CLOCK_SECOND);
+  IMPT("dtn_sv_recv: summary vector from ");
+  IMPTADDR(from);
+  IMPT(".\n");
+}
+#endif /* DTN_SUMMARY_VECTORS */
+/*-TOMBSTONES----------------------------------------------------------------*/
+#if DTN_TOMBSTONES
+struct dtn_tombstone *
+dtn_tomb_find(struct dtn_conn *c, const rimeaddr_t *esender,
+              uint16_t epacketid)
+{
+  uint8_t i;
+  for (i = 0; i < DTN_TOMBSTONES; i++) {
+    struct dtn_tombstone *t = &c->tombs[i];
+    if (t->epacketid == epacketid && rimeaddr_cmp(&(t->esender), esender)
+        && !timer_expired(&(t->lifetime))) {
+      return t;
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Remember a delivery for lifetime seconds, forgetting the oldest one if
+ * the table is full.
+ */
+struct dtn_tombstone *
+dtn_tomb_add(struct dtn_conn *c, const rimeaddr_t *esender,
+             uint16_t epacketid, uint16_t lifetime)
+{
+  struct dtn_tombstone *t = dtn_tomb_find(c, esender, epacketid);
+  uint8_t i;
+  if (t) return t;
+  // a free or expired entry, else the one with the least time left
+  for (i = 0; i < DTN_TOMBSTONES; i++) {
+    struct dtn_tombstone *e = &c->tombs[i];
+    if (timer_expired(&(e->lifetime))) {
+      t = e;
+      break;
+    }
+    if (t == NULL || timer_remaining(&(e->lifetime))
+                     < timer_remaining(&(t->lifetime))) {
+      t = e;
+    }
+  }
+  rimeaddr_copy(&(t->esender), esender);
+  t->epacketid = epacketid;
+  t->fresh = 0;
+  timer_set(&(t->lifetime), (clock_time_t)lifetime * CLOCK_SECOND);
+  return t;
+}
+/*---------------------------------------------------------------------------*/
+/* Broadcast the tombstones, if some were not announced by a neighbour. */
+void
+dtn_tomb_send(struct dtn_conn *c)
+{
+  uint8_t i, fresh = 0;
+  packetbuf_clear();
+  struct dtn_tomb_hdr *tomb = (struct dtn_tomb_hdr *)packetbuf_dataptr();
+  uint8_t *e = (uint8_t *)(tomb + 1);
+  tomb->version = DTN_VERSION;
+  tomb->magic[0] = DTN_MAGIC;
+  tomb->magic[1] = DTN_MAGIC_TOMB;
+  tomb->count = 0;
+  for (i = 0; i < DTN_TOMBSTONES && tomb->count < DTN_TOMB_MAX_ENTRIES; i++) {
+    struct dtn_tombstone *t = &c->tombs[i];
+    clock_time_t left;
+    if (timer_expired(&(t->lifetime))) continue;
+    fresh |= t->fresh;
+    t->fresh = 0;
+    // in network byte order like the adverts, with the seconds left
+    left = (timer_remaining(&(t->lifetime)) + CLOCK_SECOND - 1)
+           / CLOCK_SECOND;
+    memcpy(e, &(t->esender), RIMEADDR_SIZE);
+    e = dtn_put16(e + RIMEADDR_SIZE, t->epacketid);
+    e = dtn_put16(e, left > 0xffff ? 0xffff : left);
+    tomb->count++;
+  }
+  if (!fresh) {
+    INFO("dtn_tomb_send: tombstones already announced, not sent.\n");
+    return;
+  }
+  packetbuf_set_datalen(sizeof(struct dtn_tomb_hdr)
+                        + tomb->count * DTN_TOMB_ENTRY);
+  broadcast_send(&c->spray_c);
+  IMPT("dtn_tomb_send: broadcast %d tombstones sent.\n", tomb->count);
+}
+/*---------------------------------------------------------------------------*/
+/* Queue the tombstones behind the frames already waiting. */
+void
+dtn_tomb_timer(void *ptr)
+{
+  dtn_tx_add((struct dtn_conn *)ptr, DTN_TX_TOMB, NULL);
+}
+/*---------------------------------------------------------------------------*/
+/* Announce t shortly, unless a neighbour announces it first. */
+void
+dtn_tomb_announce(struct dtn_conn *c, struct dtn_tombstone *t)
+{
+  t->fresh = 1;
+  if (ctimer_expired(&c->tomb_ct)) {
+    ctimer_set(&c->tomb_ct, random_rand() % DTN_TOMB_DELAY + 1,
+               dtn_tomb_timer, (void *)c);
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Whether the bundle was delivered already, if so tell the neighbours. */
+int
+dtn_tomb_stale(struct dtn_conn *c, const rimeaddr_t *esender,
+               uint16_t epacketid)
+{
+  struct dtn_tombstone *t = dtn_tomb_find(c, esender, epacketid);
+  if (t == NULL) return 0;
+  dtn_tomb_announce(c, t);
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+int
+dtn_valid_tomb(void)
+{
+  struct dtn_tomb_hdr *tomb = (struct dtn_tomb_hdr *)packetbuf_dataptr();
+  return packetbuf_datalen() >= sizeof(struct dtn_tomb_hdr)
+         && tomb->version == DTN_VERSION
+         && tomb->magic[0] == DTN_MAGIC
+         && tomb->magic[1] == DTN_MAGIC_TOMB
+         && packetbuf_datalen() >= sizeof(struct dtn_tomb_hdr)
+                                   + tomb->count * DTN_TOMB_ENTRY;
+}
+/*---------------------------------------------------------------------------*/
+void
+dtn_tomb_recv(struct dtn_conn *c, const rimeaddr_t *from)
+{
+  struct dtn_tomb_hdr *tomb = (struct dtn_tomb_hdr *)packetbuf_dataptr();
+  const uint8_t *p = (const uint8_t *)(tomb + 1);
+  struct dtn_tomb_entry e;
+  uint8_t i;
+  IMPT("dtn_tomb_recv: %d tombstones from ", tomb->count);
+  IMPTADDR(from);
+  IMPT(".\n");
+  for (i = 0; i < tomb->count; i++, p += DTN_TOMB_ENTRY) {
+    memcpy(&(e.esender), p, RIMEADDR_SIZE);
+    e.epacketid = dtn_get16(p + RIMEADDR_SIZE);
+    e.lifetime = dtn_get16(p + RIMEADDR_SIZE + 2);
+    struct dtn_tombstone *t = dtn_tomb_find(c, &(e.esender), e.epacketid);
+    if (t) { // the neighbours heard it too
+      t->fresh = 0;
+      continue;
+    }
+    // forgotten when the sender's is, so it does not circulate forever
+    t = dtn_tomb_add(c, &(e.esender), e.epacketid,
+                     e.lifetime < DTN_TOMB_LIFETIME ? e.lifetime
+                                                    : DTN_TOMB_LIFETIME);
+    struct dtn_bundle *b = dtn_store_find(&c->store, &(e.esender),
+                                          e.epacketid);
+    if (b) { // other neighbours may hold copies as well
+      INFO("dtn_tomb_recv: bundle delivered, removed.\n");
+      dtn_store_remove(&c->store, b);
+      dtn_tomb_announce(c, t);
+    }
+  }
+}
+#endif /* DTN_TOMBSTONES */
+/*-GROUPS--------------------------------------------------------------------*/
+/* Whether a bundle to addr is to be passed to our application. */
+int
+dtn_addressed(struct dtn_conn *c, const rimeaddr_t *addr)
+{
+#if DTN_GROUPS
+  uint8_t i;
+  if (dtn_is_group(addr)) {
+    for (i = 0; i < c->groups_len; i++) {
+      if (c->groups[i] == addr->u8[0]) return 1;
+    }
+    return 0;
+  }
+#endif
+  return rimeaddr_cmp(addr, &rimeaddr_node_addr);
+}
+/*---------------------------------------------------------------------------*/
+#if DTN_GROUPS
+/* Whether the group bundle hdr names was delivered here. */
+int
+dtn_group_got(struct dtn_conn *c, const struct dtn_hdr *hdr)
+{
+  uint8_t i;
+  for (i = 0; i < DTN_GROUP_SEEN; i++) {
+    struct dtn_group_seen *g = &c->group_seen[i];
+    if (g->epacketid == hdr->epacketid
+        && rimeaddr_cmp(&(g->esender), &(hdr->esender))) {
+      return 1;
+    }
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+/* Whether the group bundle hdr names is new here, if so remember it. */
+int
+dtn_group_first(struct dtn_conn *c, const struct dtn_hdr *hdr)
+{
+  struct dtn_group_seen *g;
+  if (dtn_group_got(c, hdr)) return 0;
+  g = &c->group_seen[c->group_seen_next];
+  c->group_seen_next = (c->group_seen_next + 1) % DTN_GROUP_SEEN;
+  rimeaddr_copy(&(g->esender), &(hdr->esender));
+  g->epacketid = hdr->epacketid;
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+/* Note that member has the group bundle, return whether all of them do. */
+int
+dtn_group_cover(struct dtn_bundle *b, const rimeaddr_t *member)
+{
+  uint8_t i;
+  for (i = 0; i < b->covered_len; i++) {
+    if (rimeaddr_cmp(&(b->covered[i]), member)) break;
+  }
+  if (i == b->covered_len && i < DTN_GROUP_MEMBERS) {
+    rimeaddr_copy(&(b->covered[b->covered_len++]), member);
+    IMPT("dtn_group_cover: %d of %d members reached.\n", b->covered_len,
+         b->members);
+  }
+  return b->members > 0 && b->covered_len >= b->members;
+}
+#endif /* DTN_GROUPS */
+/*---------------------------------------------------------------------------*/
+/* Send the origin of the bundle hdr names an ack of its delivery. */
+void
+dtn_ack(struct dtn_conn *c, const struct dtn_hdr *hdr)
+{
+  struct dtn_hdr ack;
+  packetbuf_copyfrom(&(hdr->epacketid), sizeof(uint16_t));
+  rimeaddr_copy(&ack.ereceiver, &(hdr->esender));
+  ack.num_copies = DTN_L_COPIES;
+  ack.lifetime = DTN_MAX_LIFETIME;
+  ack.priority = hdr->priority;
+  ack.flags = DTN_FLAG_ACK;
+  ack.members = 0;
+  if (dtn_originate(c, &ack)) {
+    IMPT("dtn_ack: delivery ack sent.\n");
+  }
+}
+/*---------------------------------------------------------------------------*/
+#if DTN_FRAG_MAX
+/* Whether the message the fragment hdr belongs to was passed on lately. */
+int
+dtn_reasm_done(struct dtn_conn *c, const struct dtn_hdr *hdr)
+{
+  uint16_t base = hdr->epacketid - hdr->frag_index;
+  uint8_t i;
+  for (i = 0; i < DTN_REASM_DONE; i++) {
+    struct dtn_reasm_done *d = &c->reasm_done[i];
+    if (d->base == base && rimeaddr_cmp(&(d->esender), &(hdr->esender))) {
+      return 1;
+    }
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+/* Remember the message of r was passed on, in place of the oldest one. */
+void
+dtn_reasm_passed(struct dtn_conn *c, const struct dtn_reasm *r)
+{
+  struct dtn_reasm_done *d = &c->reasm_done[c->reasm_done_next];
+  c->reasm_done_next = (c->reasm_done_next + 1) % DTN_REASM_DONE;
+  rimeaddr_copy(&(d->esender), &(r->esender));
+  d->base = r->base;
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Copy the fragment addressed to us in the packet buffer into its
+ * reassembly, return the reassembly, NULL if the fragment was dropped.
+ */
+struct dtn_reasm *
+dtn_reasm_add(struct dtn_conn *c, const struct dtn_hdr *hdr)
+{
+  struct dtn_reasm *r, *found = NULL, *spare = NULL;
+  uint16_t base = hdr->epacketid - hdr->frag_index;
+  uint16_t len = packetbuf_datalen();
+  uint8_t i = hdr->frag_index;
+  if (hdr->frag_count > DTN_FRAG_MAX || i >= hdr->frag_count
+      || len > DTN_FRAG_SIZE
+      || (i + 1 < hdr->frag_count && len != DTN_FRAG_SIZE)) {
+    IMPT("dtn_reasm_add: fragment malformed, dropped.\n");
+    return NULL;
+  }
+  for (r = c->reasm; r < c->reasm + DTN_REASSEMBLY; r++) {
+    if (r->count > 0 && r->base == base
+        && rimeaddr_cmp(&(r->esender), &(hdr->esender))) {
+      found = r;
+      break;
+    }
+    if (spare == NULL && (r->count == 0 || timer_expired(&r->lifetime))) {
+      spare = r;
+    }
+  }
+  if (found == NULL) {
+    if (spare == NULL) {
+      IMPT("dtn_reasm_add: no reassembly free, fragment dropped.\n");
+      return NULL;
+    }
+    found = spare;
+    rimeaddr_copy(&(found->esender), &(hdr->esender));
+    found->base = base;
+    found->count = hdr->frag_count;
+    found->got = 0;
+    found->len = 0;
+    memset(found->have, 0, sizeof(found->have));
+    timer_set(&found->lifetime, (clock_time_t)hdr->lifetime * CLOCK_SECOND);
+  } else if (found->count != hdr->frag_count) {
+    IMPT("dtn_reasm_add: fragment count mismatch, dropped.\n");
+    return NULL;
+  }
+  if (!(found->have[i / 8] & 1 << (i % 8))) {
+    found->have[i / 8] |= 1 << (i % 8);
+    memcpy(found->data + (uint16_t)i * DTN_FRAG_SIZE, packetbuf_dataptr(),
+           len);
+    found->got++;
+    found->len += len;
+  }
+  INFO("dtn_reasm_add: fragment %d of %d, %d received.\n", i + 1,
+       found->count, found->got);
+  return found;
+}
+#endif /* DTN_FRAG_MAX */
+/*---------------------------------------------------------------------------*/
+/* Pass the message in the packet buffer to the application. */
+void
+dtn_recv_msg(struct dtn_conn *c, const rimeaddr_t *from, uint16_t packetid)
+{
+  if (c->cb->recv_data) {
+    c->cb->recv_data(c, from, packetid, packetbuf_dataptr(),
+                     packetbuf_datalen());
+  } else {
+    c->cb->recv(c, from, packetid);
+  }
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Pass a bundle addressed to us to the application, once. Returns 0 if it
+ * was not taken, so the sender must keep it, 1 if it was or had been.
+ */
+int
+dtn_deliver(struct dtn_conn *c, const struct dtn_hdr *hdr)
+{
+#if DTN_GROUPS
+  if (dtn_is_group(&(hdr->ereceiver)) && !dtn_group_first(c, hdr)) {
+    IMPT("dtn_deliver: group bundle delivered already.\n");
+    DTN_STAT(c, duplicates);
+    DTN_TRACE_EVENT(c, DTN_TRACE_DUPLICATE, &(hdr->esender), hdr->epacketid,
+                    NULL, hdr->num_copies);
+    return 1;
+  }
+#endif
+#if DTN_TOMBSTONES
+  // the other members of a group may still need it, so no tombstone
+  if (!dtn_is_group(&(hdr->ereceiver))
+      && dtn_tomb_stale(c, &(hdr->esender), hdr->epacketid)) {
+    IMPT("dtn_deliver: delivered already, announcing the tombstone.\n");
+    DTN_STAT(c, duplicates);
+    DTN_TRACE_EVENT(c, DTN_TRACE_DUPLICATE, &(hdr->esender), hdr->epacketid,
+                    NULL, hdr->num_copies);
+    return 1;
+  }
+#endif
+  if (hdr->flags & DTN_FLAG_ACK) {
+    uint16_t packetid;
+    if (packetbuf_datalen() < sizeof(packetid)) return 0;
+    memcpy(&packetid, packetbuf_dataptr(), sizeof(packetid));
+    IMPT("dtn_deliver: delivery ack, invoking callback.\n");
+    if (c->cb->acked) {
+      c->cb->acked(c, &(hdr->esender), packetid);
+    }
+  } else if (hdr->flags & DTN_FLAG_FRAG) {
+#if DTN_FRAG_MAX
+    struct dtn_reasm *r;
+    if (dtn_reasm_done(c, hdr)) { // a late copy must not start it over
+      IMPT("dtn_deliver: fragment of a message passed on already.\n");
+      DTN_STAT(c, duplicates);
+      DTN_TRACE_EVENT(c, DTN_TRACE_DUPLICATE, &(hdr->esender),
+                      hdr->epacketid, NULL, hdr->num_copies);
+      return 1;
+    }
+    if ((r = dtn_reasm_add(c, hdr)) == NULL) {
+      return 0; // not confirmed, so sprayed again
+    }
+    DTN_STAT(c, delivered);
+    DTN_TRACE_EVENT(c, DTN_TRACE_DELIVER, &(hdr->esender), hdr->epacketid,
+                    NULL, hdr->num_copies);
+    if (r->got == r->count) {
+      IMPT("dtn_deliver: message reassembled, invoking callback.\n");
+      if (c->cb->recv_bulk) {
+        c->cb->recv_bulk(c, &(hdr->esender), r->base, r->data, r->len);
+      }
+      r->count = 0;
+      dtn_reasm_passed(c, r);
+      if (hdr->flags & DTN_FLAG_ACK_REQ) {
+        struct dtn_hdr first;
+        memcpy(&first, hdr, sizeof(struct dtn_hdr));
+        first.epacketid = r->base;
+        dtn_ack(c, &first);
+      }
+    }
+#else
+    IMPT("dtn_deliver: fragment, cannot reassemble.\n");
+    return 0;
+#endif
+  } else {
+    IMPT("dtn_deliver: invoking callback.\n");
+    DTN_STAT(c, delivered);
+    DTN_TRACE_EVENT(c, DTN_TRACE_DELIVER, &(hdr->esender), hdr->epacketid,
+                    NULL, hdr->num_copies);
+    dtn_recv_msg(c, &(hdr->esender), hdr->epacketid);
+    if (hdr->flags & DTN_FLAG_ACK_REQ) {
+      dtn_ack(c, hdr);
+    }
+  }
+#if DTN_TOMBSTONES
+  if (!dtn_is_group(&(hdr->ereceiver))) {
+    dtn_tomb_announce(c, dtn_tomb_add(c, &(hdr->esender), hdr->epacketid,
+                                      DTN_TOMB_LIFETIME));
+  }
+#endif
+#if DTN_SUMMARY_VECTORS
+  dtn_sv_delivered(c, &(hdr->esender), hdr->epacketid);
+#endif
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+/* The destination has the bundle, so the copies left are of no use. */
+void
+dtn_bundle_delivered(struct dtn_conn *c, struct dtn_bundle *b)
+{
+#if DTN_TOMBSTONES
+  dtn_tomb_add(c, &(b->esender), b->epacketid, DTN_TOMB_LIFETIME);
+  dtn_store_remove(&c->store, b);
+#else
+  b->num_copies = 0;
+  dtn_store_update(&c->store, b);
+#endif
+}
+/*---------------------------------------------------------------------------*/
+/* The bundle reached to, its destination or a member of its group. */
+void
+dtn_bundle_reached(struct dtn_conn *c, struct dtn_bundle *b,
+                   const rimeaddr_t *to)
+{
+#if DTN_GROUPS
+  if (dtn_is_group(&(b->ereceiver)) && !dtn_group_cover(b, to)) return;
+#endif
+  dtn_bundle_delivered(c, b);
+}
+/*---------------------------------------------------------------------------*/
+/* Advertise the ready bundles, as many descriptors per frame as fit. */
+int
+dtn_queue_spray_adv(struct dtn_conn *c)
+{
+  int sent = 0;
+  struct dtn_bundle *b = c->store.ready, *next;
+  while (b) {
+    packetbuf_clear();
+    struct dtn_adv_hdr *adv = (struct dtn_adv_hdr *)packetbuf_dataptr();
+    uint8_t *e = (uint8_t *)(adv + 1);
+    adv->version = DTN_VERSION;
+    adv->magic[0] = DTN_MAGIC;
+    adv->magic[1] = DTN_MAGIC_ADV;
+    adv->count = 0;
+    for (; b && adv->count < DTN_ADV_MAX_ENTRIES; b = next) {
+      next = b->rnext;
+      if (timer_expired(&b->lifetime)) {
+        INFO("dtn_queue_spray_adv: bundle expired, removed.\n");
+        dtn_store_expire(&c->store, b);
+        continue;
+      }
+#if DTN_SUMMARY_VECTORS
+      if (dtn_sv_covered(c, b)) continue;
+#endif
+      // in network byte order like the packed header, not host layout
+      memcpy(e, &(b->esender), RIMEADDR_SIZE);
+      memcpy(e + RIMEADDR_SIZE, &(b->ereceiver), RIMEADDR_SIZE);
+      e = dtn_put16(e + 2 * RIMEADDR_SIZE, b->epacketid);
+      *e++ = b->num_copies;
+      e = dtn_put16(e, dtn_encounter_age(c, &(b->ereceiver)));
+      adv->count++;
+    }
+    if (adv->count == 0) break;
+    packetbuf_set_datalen(sizeof(struct dtn_adv_hdr)
+                          + adv->count * DTN_ADV_ENTRY);
+#if DTN_CONGESTION
+    dtn_load_append(c);
+#endif
+    broadcast_send(&c->spray_c);
+    DTN_STAT(c, adverts_sent);
+    INFO("dtn_queue_spray_adv: broadcast advertisement sent.\n");
+    sent++;
+  }
+  return sent;
+}
+/*---------------------------------------------------------------------------*/
+void
+dtn_spray_send(struct dtn_conn *c, struct dtn_bundle *b)
+{
+  // b may hold another bundle by now, which is fine if it is ready too
+  if (!dtn_store_is_ready(&c->store, b)) return;
+#if DTN_SUMMARY_VECTORS
+  if (dtn_sv_covered(c, b)) {
+    INFO("dtn_spray_send: neighbours hold the bundle, skip.\n");
+    return;
+  }
+#endif
+  if (!dtn_bundle_to_packetbuf(&c->store, b)) return;
+  dtn_buf_ptr()->encounter = dtn_encounter_age(c, &(b->ereceiver));
+#if DTN_CONGESTION
+  dtn_load_stamp(c, dtn_buf_ptr());
+#endif
+  print_packetbuf("dtn_spray_send");
+  if (!dtn_buf_encode((dtn_buf_ptr()->flags & (DTN_FLAG_FRAG | DTN_FLAG_GROUP))
+                      ? DTN_HDR_PACKED : dtn_spray_version(c))) {
+    return;
+  }
+  broadcast_send(&c->spray_c);
+  DTN_STAT(c, sprays_sent);
+  DTN_TRACE_EVENT(c, DTN_TRACE_SPRAY_TX, &(b->esender), b->epacketid, NULL,
+                  b->num_copies);
+  INFO("dtn_spray_send: broadcast Spray sent.\n");
+}
+/*---------------------------------------------------------------------------*/
+/* Queue a spray of every ready bundle, one after the other. */
+void
+dtn_spray_round(struct dtn_conn *c)
+{
+  c->spray_last = clock_time();
+  // version 1 nodes around only understand whole sprays
+  if (DTN_SPRAY_ADV && dtn_spray_version(c) == DTN_HDR_PACKED) {
+    dtn_tx_add(c, DTN_TX_ADV, NULL);
+    return;
+  }
+  c->store.cursor = c->store.ready;
+  if (c->store.cursor) {
+    dtn_tx_add(c, DTN_TX_ROUND, c->store.cursor);
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Spray the next bundle of the round, and queue the round for the rest. */
+void
+dtn_spray_next(struct dtn_conn *c)
+{
+  struct dtn_bundle *b;
+  // expiring a bundle unlinks it, which moves the cursor on
+  while ((b = c->store.cursor) && timer_expired(&b->lifetime)) {
+    INFO("dtn_spray_next: bundle expired, removed.\n");
+    dtn_store_expire(&c->store, b);
+  }
+  if (b == NULL) return;
+  c->store.cursor = b->rnext;
+  dtn_spray_send(c, b);
+  if (c->store.cursor) {
+    dtn_tx_add(c, DTN_TX_ROUND, c->store.cursor);
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Start an interval of c->spray_i, after waiting for wait. */
+void
+dtn_spray_interval(struct dtn_conn *c, clock_time_t wait)
+{
+  clock_time_t t = c->spray_i / 2 + random_rand() % (c->spray_i / 2);
+  c->spray_rest = c->spray_i - t;
+  c->spray_heard = 0;
+  c->spray_lacked = 0;
+  ctimer_set(&c->spray_ct, wait + t, dtn_queue_spray, (void *)c);
+}
+/*---------------------------------------------------------------------------*/
+void
+dtn_queue_spray(void *ptr)
+{
+  struct dtn_conn *c = (struct dtn_conn *)ptr;
+  IMPT("dtn_queue_spray: Spraying, queue length: %d\n", c->store.len);
+  
+  if (c->store.ready == NULL) {
+    IMPT("dtn_queue_spray: No ready bundle, nothing to spray, stopped.\n");
+    return;
+  }
+  
+  if (!dtn_neighbours_around(c)) {
+    IMPT("dtn_queue_spray: No neighbour around, stopped.\n");
+    c->spray_i = DTN_SPRAY_MIN_INTERVAL;
+    return;
+  }
+  
+  // sprays heard do not help a neighbour that asked for a bundle of ours
+  if (DTN_SPRAY_REDUNDANCY && c->spray_heard >= DTN_SPRAY_REDUNDANCY
+      && !c->spray_lacked) {
+    IMPT("dtn_queue_spray: Neighbours spray the same bundles, suppressed.\n");
+  } else {
+    dtn_spray_round(c);
+  }
+  
+  if (c->spray_i < DTN_SPRAY_MAX_INTERVAL) {
+    c->spray_i *= 2;
+  }
+  INFO("dtn_queue_spray: Paused spraying for %lu ticks.\n",
+       (unsigned long)c->spray_i);
+  dtn_spray_interval(c, c->spray_rest);
+}
+/*---------------------------------------------------------------------------*/
+/* Something changed around us, spray at the fastest rate again. */
+void
+dtn_spray_reset(struct dtn_conn *c)
+{
+  if (c->spray_i == DTN_SPRAY_MIN_INTERVAL && !ctimer_expired(&c->spray_ct)) {
+    return;
+  }
+  c->spray_i = DTN_SPRAY_MIN_INTERVAL;
+  if (c->store.ready) {
+    INFO("dtn_spray_reset: Spray interval reset.\n");
+    dtn_spray_interval(c, 0);
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* A neighbour showed up, spray the ready bundles to it now. */
+void
+dtn_contact(struct dtn_conn *c)
+{
+#if DTN_BEACON
+  // unless the last round was so recent the neighbour may have heard it
+  if (c->store.ready && (clock_time_t)(clock_time() - c->spray_last)
+                        >= DTN_SPRAY_MIN_INTERVAL / 2) {
+    INFO("dtn_contact: New contact, spraying.\n");
+    dtn_spray_round(c);
+    c->spray_i = DTN_SPRAY_MIN_INTERVAL;
+    dtn_spray_interval(c, 0);
+    return;
+  }
+#endif
+  dtn_spray_reset(c);
+}
+/*---------------------------------------------------------------------------*/
+/* A bundle was stored, spray it now and the others soon. */
+void
+dtn_spray_new(struct dtn_conn *c, struct dtn_bundle *b)
+{
+  if (dtn_store_is_ready(&c->store, b) && dtn_neighbours_around(c)) {
+    if (DTN_SPRAY_ADV && dtn_spray_version(c) == DTN_HDR_PACKED) {
+      dtn_tx_add(c, DTN_TX_ADV, NULL);
+    } else {
+      dtn_tx_add(c, DTN_TX_SPRAY, b);
+    }
+  }
+  dtn_spray_reset(c);
+}
+/*---------------------------------------------------------------------------*/
+/* Note a neighbour was heard from, whether it is a new one. */
+int
+dtn_neighbour_heard(struct dtn_conn *c, const rimeaddr_t *from)
+{
+  struct dtn_neighbour *n = NULL;
+  clock_time_t now = clock_time();
+  uint8_t i, known;
+  for (i = 0; i < DTN_NEIGHBOURS; i++) {
+    struct dtn_neighbour *e = &c->nbrs[i];
+    if (rimeaddr_cmp(&(e->addr), from)) {
+      n = e;
+      break;
+    }
+    // otherwise reuse the one heard from the longest ago
+    if (n == NULL || (clock_time_t)(now - e->heard)
+                     > (clock_time_t)(now - n->heard)) {
+      n = e;
+    }
+  }
+  if (!rimeaddr_cmp(&(n->addr), from)) {
+    n->version = DTN_HDR_UNKNOWN;
+#if DTN_CONGESTION
+    n->room = DTN_ROOM_UNKNOWN;
+#endif
+  }
+  known = rimeaddr_cmp(&(n->addr), from)
+          && (clock_time_t)(now - n->heard) < DTN_NEIGHBOUR_TIMEOUT;
+  rimeaddr_copy(&(n->addr), from);
+  n->heard = now;
+  return !known;
+}
+/*---------------------------------------------------------------------------*/
+/* Whether anyone is there to spray to, always so without beacons. */
+int
+dtn_neighbours_around(struct dtn_conn *c)
+{
+#if DTN_BEACON
+  clock_time_t now = clock_time();
+  uint8_t i;
+  for (i = 0; i < DTN_NEIGHBOURS; i++) {
+    struct dtn_neighbour *n = &c->nbrs[i];
+    if (n->heard && (clock_time_t)(now - n->heard) < DTN_NEIGHBOUR_TIMEOUT) {
+      return 1;
+    }
+  }
+  return 0;
+#else
+  return 1;
+#endif
+}
+/*---------------------------------------------------------------------------*/
+int
+dtn_valid_beacon(void)
+{
+  struct dtn_beacon_hdr *hdr = (struct dtn_beacon_hdr *)packetbuf_dataptr();
+  return packetbuf_datalen() >= sizeof(struct dtn_beacon_hdr)
+         && hdr->version == DTN_VERSION
+         && hdr->magic[0] == DTN_MAGIC
+         && hdr->magic[1] == DTN_MAGIC_BEACON;
+}
+/*---------------------------------------------------------------------------*/
+#if DTN_BEACON
+void
+dtn_beacon_send(struct dtn_conn *c)
+{
+  packetbuf_clear();
+  struct dtn_beacon_hdr *hdr = (struct dtn_beacon_hdr *)packetbuf_dataptr();
+  hdr->version = DTN_VERSION;
+  hdr->magic[0] = DTN_MAGIC;
+  hdr->magic[1] = DTN_MAGIC_BEACON;
+  packetbuf_set_datalen(sizeof(struct dtn_beacon_hdr));
+#if DTN_CONGESTION
+  dtn_load_append(c);
+#endif
+  broadcast_send(&c->spray_c);
+  INFO("dtn_beacon_send: broadcast beacon sent.\n");
+}
+/*---------------------------------------------------------------------------*/
+/* Queue a beacon, and the next one about DTN_BEACON seconds later. */
+void
+dtn_beacon_timer(void *ptr)
+{
+  struct dtn_conn *c = (struct dtn_conn *)ptr;
+  dtn_tx_add(c, DTN_TX_BEACON, NULL);
+  ctimer_set(&c->beacon_ct, DTN_BEACON_INTERVAL * 3 / 4
+             + random_rand() % (DTN_BEACON_INTERVAL / 2 + 1),
+             dtn_beacon_timer, (void *)c);
+}
+#endif /* DTN_BEACON */
+/*---------------------------------------------------------------------------*/
+/* The neighbour's entry, NULL if it was not heard from recently. */
+struct dtn_neighbour *
+dtn_neighbour_find(struct dtn_conn *c, const rimeaddr_t *addr)
+{
+  uint8_t i;
+  for (i = 0; i < DTN_NEIGHBOURS; i++) {
+    struct dtn_neighbour *n = &c->nbrs[i];
+    if (n->heard && rimeaddr_cmp(&(n->addr), addr)) return n;
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+/* Note that from sent a header of that version, or announced it. */
+void
+dtn_neighbour_version(struct dtn_conn *c, const rimeaddr_t *from,
+                      uint8_t version)
+{
+  struct dtn_neighbour *n = dtn_neighbour_find(c, from);
+  // upgraded nodes may send raw headers too, but never the other way round
+  if (n && (n->version == DTN_HDR_UNKNOWN || version == DTN_HDR_PACKED)) {
+    n->version = version;
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Header format to answer a frame of to's that came in version. */
+uint8_t
+dtn_reply_version(struct dtn_conn *c, const rimeaddr_t *to, uint8_t version)
+{
+  struct dtn_neighbour *n = dtn_neighbour_find(c, to);
+  return n && n->version == DTN_HDR_PACKED ? DTN_HDR_PACKED : version;
+}
+/*---------------------------------------------------------------------------*/
+/* Header format of sprays, raw while a node that only sends raw is near. */
+uint8_t
+dtn_spray_version(struct dtn_conn *c)
+{
+#if DTN_HDR_COMPAT
+  clock_time_t now = clock_time();
+  uint8_t i;
+  for (i = 0; i < DTN_NEIGHBOURS; i++) {
+    struct dtn_neighbour *n = &c->nbrs[i];
+    if (n->heard && n->version == DTN_HDR_RAW
+        && (clock_time_t)(now - n->heard) < DTN_NEIGHBOUR_TIMEOUT) {
+      return DTN_HDR_RAW;
+    }
+  }
+#endif
+  return DTN_HDR_PACKED;
+}
+/*---------------------------------------------------------------------------*/
+/* Seconds since we last heard from addr, DTN_ENCOUNTER_NEVER if unknown. */
+uint16_t
+dtn_encounter_age(struct dtn_conn *c, const rimeaddr_t *addr)
+{
+  struct dtn_neighbour *n = dtn_neighbour_find(c, addr);
+  if (n) {
+    clock_time_t age = (clock_time_t)(clock_time() - n->heard) / CLOCK_SECOND;
+    return age < DTN_ENCOUNTER_NEVER ? age : DTN_ENCOUNTER_NEVER - 1;
+  }
+  return DTN_ENCOUNTER_NEVER;
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Whether a node that heard from the destination of a bundle age seconds
+ * ago is to take its last copy over from a holder that did holder seconds
+ * ago.
+ */
+int
+dtn_focus(uint16_t age, uint16_t holder)
+{
+#if DTN_FOCUS
+  return age != DTN_ENCOUNTER_NEVER
+         && (uint32_t)age + DTN_FOCUS_THRESHOLD < holder;
+#else
+  return 0;
+#endif
+}
+/*---------------------------------------------------------------------------*/
+/* Decode the header of a received message, leaving the payload. */
+int
+dtn_valid_hdr(void)
+{
+  if (dtn_buf_decode()) {
+    return 1;
+  } else {
+    IMPT("dtn_valid_hdr: packet invalid.\n");
+    return 0;
+  }
+}
+/*---------------------------------------------------------------------------*/
+int
+dtn_valid_adv(void)
+{
+  struct dtn_adv_hdr *adv = (struct dtn_adv_hdr *)packetbuf_dataptr();
+  return packetbuf_datalen() >= sizeof(struct dtn_adv_hdr)
+         && adv->version == DTN_VERSION
+         && adv->magic[0] == DTN_MAGIC
+         && adv->magic[1] == DTN_MAGIC_ADV
+         && adv->count <= DTN_ADV_MAX_ENTRIES
+         && packetbuf_datalen() >= sizeof(struct dtn_adv_hdr)
+                                   + adv->count * DTN_ADV_ENTRY;
+}
+/*-CONGESTION----------------------------------------------------------------*/
+#if DTN_CONGESTION
+/* Free slots of the store, as advertised. */
+uint8_t
+dtn_store_room(struct dtn_store *s)
+{
+  uint16_t room = s->size - s->len;
+  return room < DTN_ROOM_UNKNOWN ? room : DTN_ROOM_UNKNOWN - 1;
+}
+/*---------------------------------------------------------------------------*/
+/* Share of the store in use, in 256ths. */
+uint8_t
+dtn_store_fill(struct dtn_store *s)
+{
+  return (uint32_t)s->len * 255 / s->size;
+}
+/*---------------------------------------------------------------------------*/
+/* Advertise the room left in our store in a header about to be sent. */
+void
+dtn_load_stamp(struct dtn_conn *c, struct dtn_hdr *hdr)
+{
+  hdr->flags |= DTN_FLAG_LOAD;
+  hdr->room = dtn_store_room(&c->store);
+  hdr->load = dtn_store_fill(&c->store);
+}
+/*---------------------------------------------------------------------------*/
+/* Advertise it after the beacon or advertisement in the packet buffer. */
+void
+dtn_load_append(struct dtn_conn *c)
+{
+  uint16_t len = packetbuf_datalen();
+  uint8_t *p = (uint8_t *)packetbuf_dataptr() + len;
+  if (len + 2 > PACKETBUF_SIZE) return;
+  p[0] = dtn_store_room(&c->store);
+  p[1] = dtn_store_fill(&c->store);
+  packetbuf_set_datalen(len + 2);
+}
+/*---------------------------------------------------------------------------*/
+/* Note the room a neighbour advertised, unless it advertised none. */
+void
+dtn_load_heard(struct dtn_conn *c, const rimeaddr_t *from, uint8_t room,
+               uint8_t load)
+{
+  struct dtn_neighbour *n = dtn_neighbour_find(c, from);
+  if (n && room != DTN_ROOM_UNKNOWN) {
+    n->room = room;
+    n->load = load;
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Note the room advertised after the first len bytes of the frame, if any. */
+void
+dtn_load_trailer(struct dtn_conn *c, const rimeaddr_t *from, uint16_t len)
+{
+  uint8_t *p = (uint8_t *)packetbuf_dataptr() + len;
+  if (packetbuf_datalen() >= len + 2) {
+    dtn_load_heard(c, from, p[0], p[1]);
+  }
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Whether our store is too full to take relay copies from the neighbour,
+ * which would only push out bundles we hold, unless its store is fuller.
+ */
+int
+dtn_store_congested(struct dtn_conn *c, struct dtn_neighbour *n)
+{
+  uint8_t load = dtn_store_fill(&c->store);
+  return n && n->room != DTN_ROOM_UNKNOWN && load > n->load
+         && (uint16_t)load * 100 >= (uint16_t)DTN_CONGESTION * 255;
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Copies of num_copies to give the neighbour, in proportion to how much
+ * emptier its store is than ours, half if it did not say.
+ */
+uint16_t
+dtn_load_share(struct dtn_conn *c, struct dtn_neighbour *n,
+               uint16_t num_copies)
+{
+  uint16_t mine, theirs, share;
+  if (n == NULL || n->room == DTN_ROOM_UNKNOWN) return num_copies / 2;
+  if (n->room == 0) return 1; // it pushed another bundle out for this one
+  mine = 256 - dtn_store_fill(&c->store);
+  theirs = 256 - n->load;
+  share = (uint32_t)num_copies * theirs / (mine + theirs);
+  return share ? share : 1;
+}
+#endif /* DTN_CONGESTION */
+/*-SPRAY---------------------------------------------------------------------*/
+/* Queue a request for the bundle hdr names, to its sprayer. */
+void
+dtn_request(struct dtn_conn *c, const rimeaddr_t *to,
+            const struct dtn_hdr *hdr)
+{
+  struct dtn_tx *tx = dtn_tx_add(c, DTN_TX_REQUEST, NULL);
+  if (tx == NULL) return;
+  rimeaddr_copy(&(tx->esender), &(hdr->esender));
+  tx->epacketid = hdr->epacketid;
+  tx->encounter = dtn_encounter_age(c, &(hdr->ereceiver));
+  tx->num_copies = hdr->num_copies;
+  tx->version = hdr->version;
+  tx->flags = 0;
+  if (dtn_is_group(&(hdr->ereceiver))) { // only upgraded nodes hold them
+    tx->version = DTN_HDR_PACKED;
+  }
+#if DTN_GROUPS
+  // a member of the group asks for no copies, and with no copies left
+  // tells it has the bundle already, so it is not handed over again
+  if (dtn_is_group(&(hdr->ereceiver)) && dtn_addressed(c, &(hdr->ereceiver))) {
+    tx->flags = DTN_FLAG_GROUP;
+    if (dtn_group_got(c, hdr)) tx->num_copies = 0;
+  }
+#endif
+  rimeaddr_copy(&(tx->to), to);
+#if DTN_BATCH > 1
+  tx->queued = clock_time();
+#endif
+  IMPT("dtn_request: Request to ");
+  IMPTADDR(to);
+  IMPT(" queued.\n");
+}
+/*---------------------------------------------------------------------------*/
+/* Whether e was requested within the hold-off, remember it if not. Without
+   a placeholder in the store, every advert heard would ask again. */
+int
+dtn_adv_asked(struct dtn_conn *c, const struct dtn_adv_entry *e)
+{
+  uint8_t i;
+  struct dtn_adv_asked *a;
+  for (i = 0; i < DTN_ADV_ASKED; i++) {
+    a = &c->adv_asked[i];
+    if (a->epacketid == e->epacketid
+        && rimeaddr_cmp(&(a->esender), &(e->esender))
+        && (clock_time_t)(clock_time() - a->when) < DTN_ADV_HOLDOFF) {
+      return 1;
+    }
+  }
+  a = &c->adv_asked[c->adv_asked_next];
+  c->adv_asked_next = (c->adv_asked_next + 1) % DTN_ADV_ASKED;
+  rimeaddr_copy(&(a->esender), &(e->esender));
+  a->epacketid = e->epacketid;
+  a->when = clock_time();
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+/* Ask the sprayer for the bundle a descriptor names. */
+void
+dtn_adv_request(struct dtn_conn *c, const rimeaddr_t *from,
+                const struct dtn_adv_entry *e)
+{
+  struct dtn_hdr hdr;
+  hdr.version = DTN_HDR_PACKED; // only upgraded nodes advertise
+  hdr.num_copies = e->num_copies;
+  rimeaddr_copy(&hdr.esender, &(e->esender));
+  rimeaddr_copy(&hdr.ereceiver, &(e->ereceiver));
+  hdr.epacketid = e->epacketid;
+  hdr.priority = DTN_PRIORITY_NORMAL;
+  hdr.members = 0;
+  dtn_request(c, from, &hdr);
+}
+/*---------------------------------------------------------------------------*/
+void
+dtn_adv_recv(struct dtn_conn *c, const rimeaddr_t *from)
+{
+  struct dtn_adv_hdr *adv = (struct dtn_adv_hdr *)packetbuf_dataptr();
+  struct dtn_adv_entry entries[DTN_ADV_MAX_ENTRIES];
+  const uint8_t *p = (const uint8_t *)(adv + 1);
+  uint8_t i, count = adv->count;
+#if DTN_SUMMARY_VECTORS
+  uint8_t redundant = 0;
+#endif
+  // requests reuse the packet buffer
+  for (i = 0; i < count; i++, p += DTN_ADV_ENTRY) {
+    memcpy(&(entries[i].esender), p, RIMEADDR_SIZE);
+    memcpy(&(entries[i].ereceiver), p + RIMEADDR_SIZE, RIMEADDR_SIZE);
+    entries[i].epacketid = dtn_get16(p + 2 * RIMEADDR_SIZE);
+    entries[i].num_copies = p[2 * RIMEADDR_SIZE + 2];
+    entries[i].encounter = dtn_get16(p + 2 * RIMEADDR_SIZE + 3);
+  }
+  for (i = 0; i < count; i++) {
+    struct dtn_adv_entry *e = &entries[i];
+    int to_me = dtn_addressed(c, &(e->ereceiver));
+    if (rimeaddr_cmp(&(e->esender), &rimeaddr_node_addr)) continue;
+#if DTN_TOMBSTONES
+    if (dtn_tomb_stale(c, &(e->esender), e->epacketid)) continue;
+#endif
+    if (!to_me && (e->num_copies == 0 || (e->num_copies == 1
+        && !dtn_focus(dtn_encounter_age(c, &(e->ereceiver)), e->encounter)))) {
+      continue;
+    }
+    // the destination is next to the advertiser and asks for it itself
+    if (!to_me && e->encounter < DTN_ADV_NEAR) continue;
+    struct dtn_bundle *b = dtn_store_find(&c->store, &(e->esender),
+                                          e->epacketid);
+    if (b && b->state == DTN_READY) {
+      c->spray_heard++;
+#if DTN_SUMMARY_VECTORS
+      redundant = 1;
+#endif
+      continue;
+    }
+    if (!to_me && !b && !dtn_store_has_room(&c->store)) {
+      IMPT("dtn_adv_recv: Store full, not requesting.\n");
+      continue;
+    }
+#if DTN_CONGESTION
+    if (!to_me && !b
+        && dtn_store_congested(c, dtn_neighbour_find(c, from))) {
+      IMPT("dtn_adv_recv: Store congested, not requesting.\n");
+      DTN_STAT(c, congested);
+      continue;
+    }
+#endif
+    if (dtn_adv_asked(c, e)) {
+      INFO("dtn_adv_recv: Requested lately, not asking again.\n");
+      continue;
+    }
+    dtn_adv_request(c, from, e);
+  }
+#if DTN_SUMMARY_VECTORS
+  if (redundant) dtn_sv_send_after(c, DTN_SV_MIN_INTERVAL);
+#endif
+}
+/*---------------------------------------------------------------------------*/
+void
+dtn_spray_recv(struct broadcast_conn *b_c, const rimeaddr_t *from)
+{
+  INFO("dtn_spray_recv: broadcast received from %02x:%02x.\n",
+       from->u8[1], from->u8[0]);
+  struct dtn_conn *c = (struct dtn_conn *)
+                       ((void *)b_c - offsetof(struct dtn_conn, spray_c));
+  if (dtn_neighbour_heard(c, from)) {
+    IMPT("dtn_spray_recv: New neighbour.\n");
+    dtn_contact(c);
+  }
+  if (dtn_valid_beacon()) {
+#if DTN_CONGESTION
+    dtn_load_trailer(c, from, sizeof(struct dtn_beacon_hdr));
+#endif
+    return;
+  }
+  if (dtn_valid_adv()) {
+    DTN_STAT(c, sprays_recv);
+#if DTN_CONGESTION
+    dtn_load_trailer(c, from, sizeof(struct dtn_adv_hdr)
+                              + ((struct dtn_adv_hdr *)packetbuf_dataptr())
+                                ->count * DTN_ADV_ENTRY);
+#endif
+    dtn_adv_recv(c, from);
+    return;
+  }
+#if DTN_SUMMARY_VECTORS
+  if (dtn_valid_sv()) {
+    dtn_sv_recv(c, from);
+    return;
+  }
+#endif
+#if DTN_TOMBSTONES
+  if (dtn_valid_tomb()) {
+    dtn_tomb_recv(c, from);
+    return;
+  }
+#endif
+  if (!dtn_valid_hdr()) return;
+  DTN_STAT(c, sprays_recv);
+  print_packetbuf("dtn_spray_recv");
+  struct dtn_hdr *bufdata = dtn_buf_ptr();
+  struct dtn_hdr recv_hdr;
+  memcpy(&recv_hdr, bufdata, sizeof (struct dtn_hdr));
+  DTN_TRACE_EVENT(c, DTN_TRACE_SPRAY_RX, &(recv_hdr.esender),
+                  recv_hdr.epacketid, from, recv_hdr.num_copies);
+  dtn_neighbour_version(c, from, recv_hdr.version);
+#if DTN_CONGESTION
+  dtn_load_heard(c, from, recv_hdr.room, recv_hdr.load);
+#endif
+  
+  if (rimeaddr_cmp(&(recv_hdr.esender), &rimeaddr_node_addr)) { // from me
+    INFO("dtn_spray_recv: Spray message is from me, do nothing.\n");
+    return;
+  }
+  
+  if (dtn_addressed(c, &(recv_hdr.ereceiver))) { // to me
+    IMPT("dtn_spray_recv: Spray message is to me.\n");
+    if (dtn_deliver(c, &recv_hdr)) {
+      dtn_request(c, from, &recv_hdr); // confirms the delivery
+    }
+    return;
+  }
+  
+#if DTN_TOMBSTONES
+  if (dtn_tomb_stale(c, &(recv_hdr.esender), recv_hdr.epacketid)) {
+    INFO("dtn_spray_recv: Spray of a delivered bundle, tombstone sent.\n");
+    return;
+  }
+#endif
+  
+  if (recv_hdr.num_copies == 1 // not to me and only one copy
+      && !dtn_focus(dtn_encounter_age(c, &(recv_hdr.ereceiver)),
+                    recv_hdr.encounter)) {
+    INFO("dtn_spray_recv: Not to me and L == 1, do nothing.\n");
+    return;
+  }
+  
+  struct dtn_bundle *b;
+  if ((b = dtn_queue_find(c))) { // found in the queue
+    if (b->state == DTN_READY) {
+      INFO("dtn_spray_recv: Spray in the queue and ready, do nothing.\n");
+      c->spray_heard++;
+#if DTN_SUMMARY_VECTORS
+      dtn_sv_send_after(c, DTN_SV_MIN_INTERVAL);
+#endif
+    } else { // still pending
+      IMPT("dtn_spray_recv: Spray in queue but pending.\n");
+      dtn_request(c, from, &recv_hdr);
+    }
+    return;
+  }
+  
+  // not in the queue
+#if DTN_CONGESTION
+  if (dtn_store_congested(c, dtn_neighbour_find(c, from))) {
+    IMPT("dtn_spray_recv: Store congested, not requesting.\n");
+    DTN_STAT(c, congested);
+    return;
+  }
+#endif
+  bufdata->num_copies = 0;
+  if (dtn_store_add(&c->store, DTN_PENDING)) {
+    INFO("dtn_spray_recv: Enqueued (pending) successfully.\n");
+    dtn_request(c, from, &recv_hdr);
+  } else {
+    IMPT("dtn_spray_recv: Failed to enqueue.\n");
+  }
+}
+/*---------------------------------------------------------------------------*/
+const struct broadcast_callbacks dtn_spray_call = {dtn_spray_recv};
+/*-REQUEST-------------------------------------------------------------------*/
+/*
+ * Send the queued request tx, and name the bundles of the requests queued
+ * after it for the same neighbour in it too.
+ */
+void
+dtn_request_send(struct dtn_conn *c, struct dtn_tx *tx)
+{
+  uint8_t version = dtn_reply_version(c, &(tx->to), tx->version);
+  struct dtn_hdr *hdr;
+  packetbuf_clear();
+  hdr = dtn_buf_ptr();
+  memset(hdr, 0, sizeof(struct dtn_hdr));
+  hdr->num_copies = tx->num_copies;
+  rimeaddr_copy(&(hdr->esender), &(tx->esender));
+  rimeaddr_copy(&(hdr->ereceiver), &rimeaddr_null); // the bundle is named
+  hdr->epacketid = tx->epacketid;
+  hdr->priority = DTN_PRIORITY_NORMAL;
+  hdr->flags = tx->flags;
+  hdr->encounter = tx->encounter;
+#if DTN_CONGESTION
+  dtn_load_stamp(c, dtn_buf_ptr());
+#endif
+#if DTN_HDR_COMPAT
+  if (version == DTN_HDR_RAW) {
+    ((uint8_t *)packetbuf_dataptr())[0] = DTN_MAGIC;
+    ((uint8_t *)packetbuf_dataptr())[1] = DTN_MAGIC_PACKED;
+    packetbuf_set_datalen(2);
+    dtn_buf_ptr()->flags &= ~DTN_FLAG_GROUP; // only sent by upgraded nodes
+  }
+#endif
+#if DTN_BATCH > 1
+  // the entries have no flags, so a member's requests are sent on their own
+  if (version == DTN_HDR_PACKED && !(tx->flags & DTN_FLAG_GROUP)) {
+    uint8_t *p = (uint8_t *)packetbuf_dataptr();
+    uint8_t n = 1;
+    uint16_t i = 0;
+    struct dtn_tx more;
+    while (i < c->tx_len && n < DTN_BATCH) {
+      struct dtn_tx *q = &c->txq[(c->tx_head + i) % DTN_TX_QUEUE];
+      if (q->type != DTN_TX_REQUEST || !rimeaddr_cmp(&(q->to), &(tx->to))
+          || (q->flags & DTN_FLAG_GROUP)) {
+        i++;
+        continue;
+      }
+      dtn_tx_take(c, i, &more);
+      memcpy(p, &(more.esender), RIMEADDR_SIZE);
+      p = dtn_put16(p + RIMEADDR_SIZE, more.epacketid);
+      p = dtn_put16(p, more.encounter);
+      n++;
+      DTN_STAT(c, requests_sent);
+      DTN_TRACE_EVENT(c, DTN_TRACE_REQUEST_TX, &(more.esender),
+                      more.epacketid, &(tx->to), more.num_copies);
+    }
+    if (n > 1) {
+      dtn_buf_ptr()->flags |= DTN_FLAG_BATCH;
+      packetbuf_set_datalen(p - (uint8_t *)packetbuf_dataptr());
+      INFO("dtn_request_send: %d bundles requested at once.\n", n);
+    }
+  }
+#endif
+  dtn_buf_encode(version);
+  unicast_send(&c->request_c, &(tx->to));
+  DTN_STAT(c, requests_sent);
+  DTN_TRACE_EVENT(c, DTN_TRACE_REQUEST_TX, &(tx->esender), tx->epacketid,
+                  &(tx->to), tx->num_copies);
+  INFO("dtn_request_send: unicast Request sent.\n");
+}
+/*---------------------------------------------------------------------------*/
+#if DTN_BATCH > 1
+/*
+ * Whether to hold the request tx back, queued again, so the requests for
+ * the rest of the neighbour's spray round go out with it. It is held for
+ * DTN_BATCH_HOLD at most, and not once DTN_BATCH of them are queued.
+ */
+int
+dtn_request_hold(struct dtn_conn *c, struct dtn_tx *tx)
+{
+  uint8_t n = 1;
+  uint16_t i;
+  struct dtn_tx *q;
+  if ((clock_time_t)(clock_time() - tx->queued) >= DTN_BATCH_HOLD
+      || dtn_reply_version(c, &(tx->to), tx->version) != DTN_HDR_PACKED
+      || (tx->flags & DTN_FLAG_GROUP)) {
+    return 0;
+  }
+  for (i = 0; i < c->tx_len; i++) {
+    q = &c->txq[(c->tx_head + i) % DTN_TX_QUEUE];
+    if (q->type == DTN_TX_REQUEST && rimeaddr_cmp(&(q->to), &(tx->to))
+        && !(q->flags & DTN_FLAG_GROUP) && ++n == DTN_BATCH) {
+      return 0;
+    }
+  }
+  if ((q = dtn_tx_add(c, DTN_TX_REQUEST, NULL)) == NULL) return 0;
+  memcpy(q, tx, sizeof(struct dtn_tx));
+  return 1;
+}
+#endif
+/*---------------------------------------------------------------------------*/
+/*
+ * Hand the bundle req names over to the requester, in h if it is batched
+ * and has room, return the hand-off it went into, h if none.
+ */
+struct dtn_handoff *
+dtn_request_serve(struct dtn_conn *c, const rimeaddr_t *from,
+                  const struct dtn_hdr *req, struct dtn_handoff *h)
+{
+  struct dtn_bundle *b;
+  if (!(b = dtn_store_find(&c->store, &(req->esender), req->epacketid))) {
+    IMPT("dtn_request_serve: Request not in the queue, do nothing.\n");
+    return h;
+  }
+  if (b->state != DTN_READY) {
+    IMPT("dtn_request_serve: Request in queue, but pending, do nothing.\n");
+    return h;
+  }
+  INFO("dtn_request_serve: Request found in the queue.\n");
+  dtn_spray_reset(c); // a neighbour lacks one of our bundles
+  c->spray_lacked = 1;
+#if DTN_SUMMARY_VECTORS
+  dtn_sv_lacks(c, from, b);
+#endif
+  // a group member is a receiver, it only ever asks for the bundle itself
+  int to_receiver = rimeaddr_cmp(&(b->ereceiver), from)
+                    || (dtn_is_group(&(b->ereceiver))
+                        && (req->flags & DTN_FLAG_GROUP));
+  // the requester heard from the destination more recently, focus on it
+  int focus = !to_receiver && b->num_copies == 1
+              && dtn_focus(req->encounter,
+                           dtn_encounter_age(c, &(b->ereceiver)));
+  if (to_receiver && (!DTN_SPRAY_ADV
+                      || ((req->flags & DTN_FLAG_GROUP) && !req->num_copies))) {
+    dtn_bundle_reached(c, b, from);
+    IMPT("dtn_request_serve: receiver got message, copies dropped.\n");
+    return h;
+  }
+  if ((b->num_copies == 1) && !to_receiver && !focus) {
+    IMPT("dtn_request_serve: L == 1, and from != ereceiver, do nothing.\n");
+    return h;
+  }
+  if (b->num_copies == 0) {
+    IMPT("dtn_request_serve: L == 0, do nothing.\n");
+    return h;
+  }
+  struct dtn_handoff *slot = dtn_handoff_slot(c, from, b, h);
+  if (slot == NULL) {
+    IMPT("dtn_request_serve: No HandOff slot free, do nothing.\n");
+    return h;
+  }
+  if (slot->len == 0) {
+    struct dtn_tx *tx = dtn_tx_add(c, DTN_TX_HANDOFF, b);
+    if (tx == NULL) return h;
+    tx->slot = slot - c->handoffs;
+    rimeaddr_copy(&(slot->to), from);
+    slot->version = req->version;
+    slot->batch = (req->flags & DTN_FLAG_BATCH) != 0;
+  }
+  struct dtn_handoff_item *it = &slot->items[slot->len++];
+  it->b = b;
+  rimeaddr_copy(&(it->esender), &(b->esender));
+  it->epacketid = b->epacketid;
+  // the copies are back if the hand-off fails
+#if DTN_CONGESTION
+  it->num_copies = to_receiver ? 0 : focus ? 1
+                   : dtn_load_share(c, dtn_neighbour_find(c, from),
+                                    b->num_copies);
+#else
+  it->num_copies = to_receiver ? 0 : focus ? 1 : b->num_copies / 2;
+#endif
+  b->num_copies -= it->num_copies;
+  dtn_store_update(&c->store, b);
+  IMPT("dtn_request_serve: HandOff(L=%d) queued.\n", it->num_copies);
+  return slot;
+}
+/*---------------------------------------------------------------------------*/
+void
+dtn_request_recv(struct unicast_conn *u_c, const rimeaddr_t *from)
+{
+  INFO("dtn_request_recv: unicast received from %02x:%02x\n",
+       from->u8[1], from->u8[0]);
+  if (!dtn_valid_hdr()) return;
+  struct dtn_conn *c = (struct dtn_conn *)
+                       ((void *)u_c - offsetof(struct dtn_conn, request_c));
+  struct dtn_hdr req;
+  uint8_t *entries = NULL;
+  uint8_t i, n = 0;
+  memcpy(&req, dtn_buf_ptr(), sizeof(struct dtn_hdr));
+  DTN_STAT(c, requests_recv);
+  DTN_TRACE_EVENT(c, DTN_TRACE_REQUEST_RX, &(req.esender), req.epacketid,
+                  from, req.num_copies);
+  print_packetbuf("dtn_request_recv");
+  dtn_neighbour_heard(c, from);
+  dtn_neighbour_version(c, from, req.version);
+#if DTN_CONGESTION
+  dtn_load_heard(c, from, req.room, req.load);
+#endif
+#if DTN_HDR_COMPAT
+  // "SP" after a raw request tells the requester understands packed ones,
+  // version 1 nodes send the message there
+  if (packetbuf_datalen() == 2
+      && ((uint8_t *)packetbuf_dataptr())[0] == DTN_MAGIC
+      && ((uint8_t *)packetbuf_dataptr())[1] == DTN_MAGIC_PACKED) {
+    dtn_neighbour_version(c, from, DTN_HDR_PACKED);
+  }
+#endif
+  // the further bundles it names, read where they lie, as serving a
+  // request leaves the packet buffer alone
+  if (req.flags & DTN_FLAG_BATCH) {
+    n = packetbuf_datalen() / DTN_REQUEST_ENTRY;
+    entries = (uint8_t *)packetbuf_dataptr();
+  }
+  struct dtn_handoff *h = dtn_request_serve(c, from, &req, NULL);
+  for (i = 0; i < n; i++) {
+    uint8_t *e = entries + i * DTN_REQUEST_ENTRY;
+    memcpy(&(req.esender), e, RIMEADDR_SIZE);
+    req.epacketid = dtn_get16(e + RIMEADDR_SIZE);
+    req.encounter = dtn_get16(e + RIMEADDR_SIZE + 2);
+    DTN_STAT(c, requests_recv);
+    DTN_TRACE_EVENT(c, DTN_TRACE_REQUEST_RX, &(req.esender), req.epacketid,
+                    from, 0);
+    h = dtn_request_serve(c, from, &req, h);
+  }
+}
+/*---------------------------------------------------------------------------*/
+const struct unicast_callbacks dtn_request_call = {dtn_request_recv};
+/*-HANDOFF-------------------------------------------------------------------*/
+/*
+ * The hand-off to put b in for "to": h if it takes batches and has room,
+ * else a free one. NULL if none, or if b is already going to "to".
+ * Version 1 nodes only listen on the channel of the first, so a node not
+ * known to be upgraded only gets that one, and the others are used first.
+ */
+struct dtn_handoff *
+dtn_handoff_slot(struct dtn_conn *c, const rimeaddr_t *to,
+                 struct dtn_bundle *b, struct dtn_handoff *h)
+{
+  struct dtn_handoff *slot = NULL;
+  uint8_t i, j;
+#if DTN_HDR_COMPAT
+  struct dtn_neighbour *n = dtn_neighbour_find(c, to);
+  uint8_t legacy = n == NULL || n->version != DTN_HDR_PACKED;
+#else
+  uint8_t legacy = 0;
+#endif
+  for (i = 0; i < DTN_HANDOFFS; i++) {
+    struct dtn_handoff *o = &c->handoffs[i];
+    if (o->len == 0) {
+      if (legacy ? i == 0 : slot == NULL || slot == c->handoffs) slot = o;
+    } else if (rimeaddr_cmp(&(o->to), to)) {
+      for (j = 0; j < o->len; j++) {
+        if (o->items[j].b == b) return NULL;
+      }
+    }
+  }
+  return h && h->batch && h->len < DTN_BATCH ? h : slot;
+}
+/*---------------------------------------------------------------------------*/
+/* Whether the bundle of it is still the one that was hand-offed. */
+int
+dtn_handoff_matches(struct dtn_handoff_item *it)
+{
+  return it->b->state != DTN_FREE
+         && rimeaddr_cmp(&(it->b->esender), &(it->esender))
+         && it->b->epacketid == it->epacketid;
+}
+/*---------------------------------------------------------------------------*/
+/* Give the copies handed over in it back to its bundle. */
+void
+dtn_handoff_return(struct dtn_conn *c, struct dtn_handoff_item *it)
+{
+  if (it->num_copies > 0 && dtn_handoff_matches(it)) {
+    it->b->num_copies += it->num_copies;
+    dtn_store_update(&c->store, it->b);
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Free h, giving its copies back to the bundles if the hand-off failed. */
+void
+dtn_handoff_free(struct dtn_handoff *h, int failed)
+{
+  uint8_t i;
+  for (i = 0; failed && i < h->len; i++) {
+    dtn_handoff_return(h->conn, &h->items[i]);
+  }
+  h->len = 0;
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Send the bundles of h in one frame, built in the packet buffer straight
+ * from the store. Bundles of a batch are each followed by their payload
+ * length, and the ones that no longer fit stay with us.
+ */
+void
+dtn_handoff_send(struct dtn_handoff *h)
+{
+  uint8_t hdr[DTN_HDR_MAX_LEN];
+  uint8_t version = dtn_reply_version(h->conn, &(h->to), h->version);
+  uint8_t batch = h->len > 1;
+  uint8_t i, n = 0, hdr_len;
+  uint16_t len = 0;
+  int data_len;
+  struct dtn_hdr bundle;
+  uint8_t *frame;
+  packetbuf_clear();
+  frame = packetbuf_dataptr();
+  for (i = 0; i < h->len; i++) {
+    struct dtn_handoff_item *it = &h->items[i];
+    if (!dtn_handoff_matches(it)) {
+      IMPT("dtn_handoff_send: bundle gone, not hand-offed.\n");
+      continue;
+    }
+    if ((data_len = dtn_bundle_hdr(&h->conn->store, it->b, &bundle)) < 0) {
+      dtn_handoff_return(h->conn, it);
+      continue;
+    }
+    bundle.num_copies = it->num_copies;
+    bundle.encounter = dtn_encounter_age(h->conn, &(it->b->ereceiver));
+    if (batch) bundle.flags |= DTN_FLAG_BATCH;
+    hdr_len = dtn_hdr_encode(&bundle, version, hdr);
+    if (hdr_len == 0 || (batch && data_len > 0xff)
+        || len + hdr_len + batch + data_len > PACKETBUF_SIZE) {
+      IMPT("dtn_handoff_send: bundle does not fit, not hand-offed.\n");
+      dtn_handoff_return(h->conn, it);
+      continue;
+    }
+    if (!dtn_bundle_data(&h->conn->store, it->b,
+                         frame + len + hdr_len + batch, data_len)) {
+      dtn_handoff_return(h->conn, it);
+      continue;
+    }
+    memcpy(frame + len, hdr, hdr_len);
+    len += hdr_len;
+    if (batch) frame[len++] = data_len;
+    len += data_len;
+    memcpy(&h->items[n++], it, sizeof(struct dtn_handoff_item));
+  }
+  h->len = n;
+  if (n == 0) return;
+  packetbuf_set_datalen(len);
+  if (!runicast_send(&h->c, &(h->to), DTN_RTX)) {
+    IMPT("dtn_handoff_send: runicast HandOff not sent.\n");
+    dtn_handoff_free(h, 1);
+    return;
+  }
+  for (i = 0; i < n; i++) {
+    DTN_STAT(h->conn, handoffs_sent);
+    DTN_TRACE_EVENT(h->conn, DTN_TRACE_HANDOFF_TX, &(h->items[i].esender),
+                    h->items[i].epacketid, &(h->to), h->items[i].num_copies);
+  }
+  IMPT("dtn_handoff_send: runicast HandOff of %d bundles sending.\n", n);
+}
+/*---------------------------------------------------------------------------*/
+/* Take the bundle hand-offed in the packet buffer. */
+void
+dtn_handoff_take(struct dtn_conn *c, const rimeaddr_t *from)
+{
+  struct dtn_hdr *bufdata = dtn_buf_ptr();
+  DTN_STAT(c, handoffs_recv);
+  DTN_TRACE_EVENT(c, DTN_TRACE_HANDOFF_RX, &(bufdata->esender),
+                  bufdata->epacketid, from, bufdata->num_copies);
+  dtn_neighbour_version(c, from, bufdata->version);
+  if (dtn_addressed(c, &(bufdata->ereceiver))) { // to me
+    struct dtn_hdr recv_hdr;
+    memcpy(&recv_hdr, bufdata, sizeof(struct dtn_hdr));
+    IMPT("dtn_handoff_take: HandOff is to me.\n");
+    dtn_deliver(c, &recv_hdr);
+    return;
+  }
+#if DTN_TOMBSTONES
+  if (dtn_tomb_stale(c, &(bufdata->esender), bufdata->epacketid)) {
+    IMPT("dtn_handoff_take: HandOff of a delivered bundle, dropped.\n");
+    return;
+  }
+#endif
+  struct dtn_bundle *b;
+  if (!(b = dtn_queue_find(c))) { // not found in the queue
+    if (!(b = dtn_store_add(&c->store, DTN_PENDING))) {
+      IMPT("dtn_handoff_take: Failed to enqueue.\n");
+      return;
+    }
+    b->num_copies = 0;
+    INFO("dtn_handoff_take: HandOff enqueued.\n");
+  } else {
+    INFO("dtn_handoff_take: HandOff found in the queue.\n");
+  }
+  b->num_copies += bufdata->num_copies;
+  if (b->num_copies > DTN_MAX_COPIES) {
+    b->num_copies = DTN_MAX_COPIES;
+  }
+  b->state = DTN_READY;
+  dtn_store_update(&c->store, b);
+  INFO("dtn_handoff_take: packet state set to ready.\n");
+  IMPT("dtn_handoff_take: HandOff(L=%d) received and processed.\n",
+       bufdata->num_copies);
+  dtn_spray_new(c, b);
+}
+/*---------------------------------------------------------------------------*/
+/* Take the bundles of a batch in the packet buffer one after another. */
+void
+dtn_handoff_unbatch(struct dtn_conn *c, const rimeaddr_t *from)
+{
+  uint16_t len = packetbuf_datalen(), off = 0, data_len;
+  uint8_t hdr_len, *frame;
+  // taking a bundle reuses the packet buffer, so the frame is kept in a
+  // queue buffer, without which the store could not take bundles either
+  struct queuebuf *qb = queuebuf_new_from_packetbuf();
+  if (qb == NULL) {
+    IMPT("dtn_handoff_unbatch: no queue buffer, batch dropped.\n");
+    return;
+  }
+  frame = (uint8_t *)queuebuf_dataptr(qb);
+  while (off < len) {
+    hdr_len = dtn_hdr_decode(dtn_buf_ptr(), frame + off, len - off);
+    if (hdr_len == 0) {
+      IMPT("dtn_handoff_unbatch: packet invalid.\n");
+      break;
+    }
+    off += hdr_len;
+    data_len = len - off; // the last bundle runs to the end
+    if (dtn_buf_ptr()->flags & DTN_FLAG_BATCH) {
+      if (off == len || frame[off] > len - off - 1) {
+        IMPT("dtn_handoff_unbatch: batch truncated.\n");
+        break;
+      }
+      data_len = frame[off++];
+      dtn_buf_ptr()->flags &= ~DTN_FLAG_BATCH;
+    }
+    packetbuf_copyfrom(frame + off, data_len);
+    off += data_len;
+    dtn_handoff_take(c, from);
+  }
+  queuebuf_free(qb);
+}
+/*---------------------------------------------------------------------------*/
+void
+dtn_handoff_recv(struct runicast_conn *r_c, const rimeaddr_t *from,
+                 uint8_t seqno)
+{
+  INFO("dtn_handoff_recv: runicast received from %02x:%02x, seqno %d\n",
+       from->u8[1], from->u8[0], seqno);
+  struct dtn_conn *c = ((struct dtn_handoff *)
+                        ((void *)r_c - offsetof(struct dtn_handoff, c)))->conn;
+  uint16_t len = packetbuf_datalen();
+  uint8_t hdr_len;
+  dtn_neighbour_heard(c, from);
+  hdr_len = dtn_hdr_decode(dtn_buf_ptr(), packetbuf_dataptr(), len);
+  if (hdr_len == 0) {
+    IMPT("dtn_handoff_recv: packet invalid.\n");
+    return;
+  }
+  if (!(dtn_buf_ptr()->flags & DTN_FLAG_BATCH)) { // taken where it lies
+    packetbuf_hdrreduce(hdr_len);
+    dtn_handoff_take(c, from);
+    return;
+  }
+  dtn_handoff_unbatch(c, from);
+}
+/*---------------------------------------------------------------------------*/
+void
+dtn_handoff_sent(struct runicast_conn *r_c, const rimeaddr_t *to,
+                 uint8_t retransmissions)
+{
+  INFO("dtn_handoff_sent: runicast sent to %02x:%02x, retried %d\n",
+       to->u8[1], to->u8[0], retransmissions);
+  struct dtn_handoff *h = (struct dtn_handoff *)
+                          ((void *)r_c - offsetof(struct dtn_handoff, c));
+  uint8_t i;
+  for (i = 0; i < h->len; i++) {
+    struct dtn_handoff_item *it = &h->items[i];
+    if (!dtn_handoff_matches(it)) {
+      IMPT("dtn_handoff_sent: not matched (expired), not processed.\n");
+    } else if (rimeaddr_cmp(to, &(it->b->ereceiver))
+               || (dtn_is_group(&(it->b->ereceiver)) && it->num_copies == 0)) {
+      dtn_bundle_reached(h->conn, it->b, to);
+      IMPT("dtn_handoff_sent: receiver got message, copies dropped.\n");
+    } else {
+      IMPT("dtn_handoff_sent: HandOff(L=%d) processed.\n", it->num_copies);
+    }
+    DTN_STAT(h->conn, handoffs_acked);
+    DTN_TRACE_EVENT(h->conn, DTN_TRACE_HANDOFF_ACKED, &(it->esender),
+                    it->epacketid, &(h->to), it->num_copies);
+  }
+#if DTN_ENERGY
+  h->conn->energy.handoff += (unsigned long)h->tx_time * retransmissions;
+#endif
+#if DTN_POWER_CONTROL
+  if (h->conn->power_acked < 0xff) h->conn->power_acked++;
+#endif
+  dtn_handoff_free(h, 0);
+}
+/*---------------------------------------------------------------------------*/
+void
+dtn_handoff_timedout(struct runicast_conn *r_c, const rimeaddr_t *to,
+                     uint8_t retransmissions)
+{
+  IMPT("dtn_handoff_timedout: runicast timed out, to %02x:%02x, retried %d\n",
+       to->u8[1], to->u8[0], retransmissions);
+  struct dtn_handoff *h = (struct dtn_handoff *)
+                          ((void *)r_c - offsetof(struct dtn_handoff, c));
+  uint8_t i;
+  for (i = 0; i < h->len; i++) {
+    DTN_STAT(h->conn, handoffs_timedout);
+    DTN_TRACE_EVENT(h->conn, DTN_TRACE_HANDOFF_TIMEDOUT,
+                    &(h->items[i].esender), h->items[i].epacketid, &(h->to),
+                    h->items[i].num_copies);
+  }
+#if DTN_ENERGY
+  h->conn->energy.handoff += (unsigned long)h->tx_time * retransmissions;
+#endif
+#if DTN_POWER_CONTROL
+  if (h->conn->power_timedout < 0xff) h->conn->power_timedout++;
+#endif
+  dtn_handoff_free(h, 1);
+  IMPT("dtn_handoff_timedout: HandOff failed.\n");
+}
+/*---------------------------------------------------------------------------*/
+const struct runicast_callbacks dtn_handoff_call = {dtn_handoff_recv,
+                                                    dtn_handoff_sent,
+                                                    dtn_handoff_timedout};
+/*-ENERGY--------------------------------------------------------------------*/
+#if DTN_ENERGY
+/*
+ * Add the transmit time since "since" to the phase of a frame of that type,
+ * and return it.
+ */
+unsigned long
+dtn_energy_add(struct dtn_conn *c, uint8_t type, unsigned long since)
+{
+  unsigned long t = energest_type_time(ENERGEST_TYPE_TRANSMIT) - since;
+  if (type == DTN_TX_HANDOFF) {
+    c->energy.handoff += t;
+  } else if (type == DTN_TX_REQUEST) {
+    c->energy.request += t;
+  } else {
+    c->energy.spray += t;
+  }
+  return t;
+}
+#endif /* DTN_ENERGY */
+/*---------------------------------------------------------------------------*/
+#if DTN_POWER_CONTROL
+/*
+ * Step the transmit power towards the level that keeps DTN_POWER_DENSITY
+ * neighbours in range with hand-offs getting through.
+ */
+void
+dtn_power_adjust(void *ptr)
+{
+  struct dtn_conn *c = (struct dtn_conn *)ptr;
+  clock_time_t now = clock_time();
+  uint16_t attempts = c->power_acked + c->power_timedout;
+  uint8_t i, heard = 0, power = c->power;
+  for (i = 0; i < DTN_NEIGHBOURS; i++) {
+    struct dtn_neighbour *n = &c->nbrs[i];
+    if (n->heard && (clock_time_t)(now - n->heard) < DTN_POWER_INTERVAL) {
+      heard++;
+    }
+  }
+  if (c->power_timedout * 4 > attempts || heard < DTN_POWER_DENSITY) {
+    power = power + 2 * DTN_POWER_STEP < DTN_POWER_MAX
+            ? power + 2 * DTN_POWER_STEP : DTN_POWER_MAX;
+  } else if (heard >= 2 * DTN_POWER_DENSITY && c->power_timedout == 0) {
+    power = power > DTN_POWER_MIN + DTN_POWER_STEP
+            ? power - DTN_POWER_STEP : DTN_POWER_MIN;
+  }
+  if (power != c->power) {
+    c->power = power;
+    set_power(power);
+    IMPT("dtn_power_adjust: %d neighbours, %d of %d hand-offs failed, "
+         "power set to 0x%02x.\n", heard, c->power_timedout, attempts, power);
+  }
+  c->power_acked = c->power_timedout = 0;
+  ctimer_set(&c->power_ct, DTN_POWER_INTERVAL, dtn_power_adjust, (void *)c);
+}
+#endif /* DTN_POWER_CONTROL */
+/*-TRANSMIT QUEUE------------------------------------------------------------*/
+void
+dtn_tx_send(void *ptr)
+{
+  struct dtn_conn *c = (struct dtn_conn *)ptr;
+  struct dtn_tx tx;
+#if DTN_ENERGY
+  unsigned long tx_time = energest_type_time(ENERGEST_TYPE_TRANSMIT);
+#endif
+  memcpy(&tx, &c->txq[c->tx_head], sizeof(struct dtn_tx));
+  c->tx_head = (c->tx_head + 1) % DTN_TX_QUEUE;
+  c->tx_len--;
+  switch (tx.type) {
+  case DTN_TX_SPRAY:
+    dtn_spray_send(c, &c->store.bundles[tx.slot]);
+    break;
+  case DTN_TX_ROUND:
+    dtn_spray_next(c);
+    break;
+  case DTN_TX_ADV:
+    dtn_queue_spray_adv(c);
+    break;
+#if DTN_SUMMARY_VECTORS
+  case DTN_TX_SV:
+    dtn_sv_send(c);
+    break;
+#endif
+#if DTN_BEACON
+  case DTN_TX_BEACON:
+    dtn_beacon_send(c);
+    break;
+#endif
+#if DTN_TOMBSTONES
+  case DTN_TX_TOMB:
+    dtn_tomb_send(c);
+    break;
+#endif
+  case DTN_TX_REQUEST:
+#if DTN_BATCH > 1
+    if (dtn_request_hold(c, &tx)) break;
+#endif
+    dtn_request_send(c, &tx);
+    break;
+  case DTN_TX_HANDOFF:
+    dtn_handoff_send(&c->handoffs[tx.slot]);
+    break;
+  }
+#if DTN_ENERGY
+  tx_time = dtn_energy_add(c, tx.type, tx_time);
+  if (tx.type == DTN_TX_HANDOFF) c->handoffs[tx.slot].tx_time = tx_time;
+#endif
+  if (c->tx_len > 0) {
+    ctimer_set(&c->tx_ct, 1 + random_rand() % DTN_TX_JITTER,
+               dtn_tx_send, (void *)c);
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Take the i-th frame out of the queue, into tx. */
+void
+dtn_tx_take(struct dtn_conn *c, uint16_t i, struct dtn_tx *tx)
+{
+  memcpy(tx, &c->txq[(c->tx_head + i) % DTN_TX_QUEUE], sizeof(struct dtn_tx));
+  for (; i + 1 < c->tx_len; i++) {
+    memcpy(&c->txq[(c->tx_head + i) % DTN_TX_QUEUE],
+           &c->txq[(c->tx_head + i + 1) % DTN_TX_QUEUE],
+           sizeof(struct dtn_tx));
+  }
+  c->tx_len--;
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Queue a frame of bundle b, to be built and sent after a random delay,
+ * after the frames of the same priority or higher. NULL if the queue is
+ * full, or if the same broadcast, or a spray round, is queued already.
+ */
+struct dtn_tx *
+dtn_tx_add(struct dtn_conn *c, uint8_t type, struct dtn_bundle *b)
+{
+  struct dtn_tx *tx;
+  uint8_t priority = b ? b->priority : DTN_PRIORITY_NORMAL;
+  uint16_t slot = b ? b - c->store.bundles : DTN_TX_NO_SLOT;
+  uint16_t i;
+  if (type < DTN_TX_REQUEST) { // broadcasts
+    for (i = 0; i < c->tx_len; i++) {
+      tx = &c->txq[(c->tx_head + i) % DTN_TX_QUEUE];
+      if (tx->type == type && (tx->slot == slot || type == DTN_TX_ROUND)) {
+        return NULL;
+      }
+    }
+  }
+  if (c->tx_len == DTN_TX_QUEUE) {
+    IMPT("dtn_tx_add: Transmit queue full.\n");
+    DTN_STAT(c, tx_dropped);
+    return NULL;
+  }
+  for (i = c->tx_len; i > 0; i--) {
+    tx = &c->txq[(c->tx_head + i - 1) % DTN_TX_QUEUE];
+    if (tx->priority >= priority) break;
+    memcpy(&c->txq[(c->tx_head + i) % DTN_TX_QUEUE], tx,
+           sizeof(struct dtn_tx));
+  }
+  tx = &c->txq[(c->tx_head + i) % DTN_TX_QUEUE];
+  c->tx_len++;
+  tx->type = type;
+  tx->priority = priority;
+  tx->slot = slot;
+  if (ctimer_expired(&c->tx_ct)) {
+    ctimer_set(&c->tx_ct, 1 + random_rand() % DTN_TX_JITTER,
+               dtn_tx_send, (void *)c);
+  }
+  return tx;
+}
+/*-DTN CALLS-----------------------------------------------------------------*/
+#if DTN_QUEUE_MAX
+void
+dtn_open(struct dtn_conn *c, uint16_t dtn_channel,
+         const struct dtn_callbacks *cb)
+{
+  struct dtn_pool pool = {DTN_QUEUE_MAX, c->bundles,
+                          DTN_STORE_INDEX_SIZE, c->index, DTN_STORE_FILE};
+#if DTN_STORE_CFS
+  // one file per channel, so two connections do not share one
+  char file[sizeof(DTN_STORE_FILE) + 6];
+  dtn_store_file(file, dtn_channel);
+  pool.file = file;
+#endif
+  dtn_open_pool(c, dtn_channel, cb, &pool);
+}
+#endif
+/*---------------------------------------------------------------------------*/
+void
+dtn_open_pool(struct dtn_conn *c, uint16_t dtn_channel,
+              const struct dtn_callbacks *cb, struct dtn_pool *pool)
+{
+  uint8_t i;
+  random_init(clock_time());
+  dtn_store_init(&c->store, pool);
+  dtn_reset_stats(c);
+#if DTN_TRACE
+  c->trace_head = c->trace_len = 0;
+#endif
+  c->tx_head = c->tx_len = 0;
+  c->spray_i = DTN_SPRAY_MIN_INTERVAL;
+  c->spray_last = clock_time() - DTN_SPRAY_MIN_INTERVAL;
+  memset(c->nbrs, 0, sizeof(c->nbrs));
+#if DTN_STORE_CFS
+  c->seqno = dtn_store_seqno(&c->store);
+#else
+  c->seqno = 0;
+#endif
+  c->lifetime = DTN_MAX_LIFETIME;
+  c->cb = cb;
+#if DTN_SUMMARY_VECTORS
+  memset(c->sv_nbr, 0, sizeof(c->sv_nbr));
+  memset(c->sv_delivered, 0, sizeof(c->sv_delivered));
+  c->sv_delivered_count = 0;
+  c->sv_sent = clock_time() - DTN_SV_LIFETIME * CLOCK_SECOND;
+#endif
+#if DTN_TOMBSTONES
+  memset(c->tombs, 0, sizeof(c->tombs));
+#endif
+#if DTN_FRAG_MAX
+  memset(c->reasm, 0, sizeof(c->reasm));
+  memset(c->reasm_done, 0, sizeof(c->reasm_done));
+  c->reasm_done_next = 0;
+#endif
+  memset(c->adv_asked, 0, sizeof(c->adv_asked));
+  c->adv_asked_next = 0;
+#if DTN_GROUPS
+  c->groups_len = 0;
+  memset(c->group_seen, 0, sizeof(c->group_seen));
+  c->group_seen_next = 0;
+#endif
+  broadcast_open(&c->spray_c, dtn_channel, &dtn_spray_call);
+  unicast_open(&c->request_c, dtn_channel + 1, &dtn_request_call);
+  for (i = 0; i < DTN_HANDOFFS; i++) {
+    c->handoffs[i].conn = c;
+    c->handoffs[i].len = 0;
+    runicast_open(&c->handoffs[i].c, dtn_channel + 2 + i, &dtn_handoff_call);
+  }
+#if DTN_BEACON
+  ctimer_set(&c->beacon_ct, 1 + random_rand() % DTN_BEACON_INTERVAL,
+             dtn_beacon_timer, (void *)c);
+#endif
+#if DTN_POWER_CONTROL
+  c->power = DTN_POWER_MAX;
+  c->power_acked = c->power_timedout = 0;
+  set_power(c->power);
+  ctimer_set(&c->power_ct, DTN_POWER_INTERVAL, dtn_power_adjust, (void *)c);
+#endif
+  IMPT("dtn_open: DTN connection opened at channels %d to %d.\n",
+       dtn_channel, dtn_channel + 1 + DTN_HANDOFFS);
+  dtn_spray_reset(c); // bundles kept from before a reboot
+}
+/*---------------------------------------------------------------------------*/
+void
+dtn_close(struct dtn_conn *c)
+{
+  uint8_t i;
+  broadcast_close(&c->spray_c);
+  unicast_close(&c->request_c);
+  for (i = 0; i < DTN_HANDOFFS; i++) {
+    runicast_close(&c->handoffs[i].c);
+    c->handoffs[i].len = 0;
+  }
+  ctimer_stop(&c->spray_ct);
+  ctimer_stop(&c->tx_ct);
+  c->tx_len = 0;
+#if DTN_TOMBSTONES
+  ctimer_stop(&c->tomb_ct);
+#endif
+#if DTN_BEACON
+  ctimer_stop(&c->beacon_ct);
+#endif
+#if DTN_POWER_CONTROL
+  ctimer_stop(&c->power_ct);
+#endif
+  dtn_store_close(&c->store);
+  IMPT("dtn_close: DTN closed.");
+}
+/*---------------------------------------------------------------------------*/
+/* Store the message in the packet buffer as a bundle of ours, and spray it. */
+int
+dtn_originate(struct dtn_conn *c, struct dtn_hdr *hdr)
+{
+  hdr->version = DTN_HDR_PACKED;
+  hdr->epacketid = c->seqno;
+  hdr->encounter = DTN_ENCOUNTER_NEVER;
+  c->seqno++;
+#if DTN_STORE_CFS
+  dtn_store_set_seqno(&c->store, c->seqno);
+#endif
+  rimeaddr_copy(&hdr->esender, &rimeaddr_node_addr);
+  memcpy(dtn_buf_ptr(), hdr, sizeof(struct dtn_hdr));
+  print_packetbuf("dtn_originate");
+  struct dtn_bundle *b = dtn_store_add(&c->store, DTN_READY);
+  if (b) {
+    INFO("dtn_originate: Enqueued successfully.\n");
+    DTN_TRACE_EVENT(c, DTN_TRACE_SEND, &(hdr->esender), hdr->epacketid,
+                    &(hdr->ereceiver), hdr->num_copies);
+    dtn_spray_new(c, b);
+    return 1;
+  } else {
+    IMPT("dtn_originate: Failed to enqueue.\n");
+    return 0;
+  }
+}
+/*---------------------------------------------------------------------------*/
+int
+dtn_send(struct dtn_conn *c, const rimeaddr_t *to)
+{
+  return dtn_send_ex(c, to, NULL);
+}
+/*---------------------------------------------------------------------------*/
+/* Fill in the header of a message to send with the given options. */
+void
+dtn_opts_hdr(struct dtn_conn *c, struct dtn_hdr *hdr, const rimeaddr_t *to,
+             const struct dtn_send_opts *opts)
+{
+  hdr->num_copies = DTN_L_COPIES;
+  hdr->lifetime = c->lifetime;
+  hdr->priority = DTN_PRIORITY_NORMAL;
+  hdr->flags = opts && opts->ack ? DTN_FLAG_ACK_REQ : 0;
+  hdr->members = 0;
+  if (opts) {
+    if (opts->num_copies) {
+      hdr->num_copies = opts->num_copies < DTN_MAX_COPIES ? opts->num_copies
+                                                          : DTN_MAX_COPIES;
+    }
+    if (opts->lifetime) {
+      hdr->lifetime = opts->lifetime < DTN_MAX_LIFETIME ? opts->lifetime
+                                                        : DTN_MAX_LIFETIME;
+    }
+    // the header has two bits for it, and 3 is no priority of ours
+    hdr->priority = opts->priority < DTN_PRIORITY_EXPEDITED
+                    ? opts->priority : DTN_PRIORITY_EXPEDITED;
+  }
+  rimeaddr_copy(&(hdr->ereceiver), to);
+}
+/*---------------------------------------------------------------------------*/
+int
+dtn_send_ex(struct dtn_conn *c, const rimeaddr_t *to,
+            const struct dtn_send_opts *opts)
+{
+  if (rimeaddr_cmp(to, &rimeaddr_node_addr)) { // to me
+    IMPT("dtn_send_ex: send to myself, invoking callback.\n");
+    dtn_recv_msg(c, to, c->seqno);
+    if (opts && opts->ack && c->cb->acked) {
+      c->cb->acked(c, to, c->seqno);
+    }
+    c->seqno++;
+    return 1;
+  }
+  struct dtn_hdr hdr;
+  dtn_opts_hdr(c, &hdr, to, opts);
+  return dtn_originate(c, &hdr);
+}
+/*---------------------------------------------------------------------------*/
+int
+dtn_send_iov(struct dtn_conn *c, const rimeaddr_t *to,
+             const struct dtn_iov *iov, uint8_t iov_len,
+             const struct dtn_send_opts *opts)
+{
+  uint8_t *p;
+  uint16_t len = 0;
+  uint8_t i;
+  packetbuf_clear();
+  p = packetbuf_dataptr();
+  for (i = 0; i < iov_len; i++) {
+    if (iov[i].len > PACKETBUF_SIZE - DTN_HDR_MAX_LEN - len) {
+      IMPT("dtn_send_iov: message does not fit in a packet buffer.\n");
+      return 0;
+    }
+    memcpy(p + len, iov[i].data, iov[i].len);
+    len += iov[i].len;
+  }
+  packetbuf_set_datalen(len);
+  return dtn_send_ex(c, to, opts);
+}
+/*---------------------------------------------------------------------------*/
+int
+dtn_send_bulk(struct dtn_conn *c, const rimeaddr_t *to, const void *data,
+              uint16_t len, const struct dtn_send_opts *opts)
+{
+#if DTN_FRAG_MAX
+  uint16_t n = (len + DTN_FRAG_SIZE - 1) / DTN_FRAG_SIZE;
+  uint8_t i;
+  if (len == 0 || n > DTN_FRAG_MAX) {
+    IMPT("dtn_send_bulk: %d bytes cannot be fragmented.\n", len);
+    return 0;
+  }
+  if (rimeaddr_cmp(to, &rimeaddr_node_addr)) { // to me
+    IMPT("dtn_send_bulk: send to myself, invoking callback.\n");
+    if (c->cb->recv_bulk) {
+      c->cb->recv_bulk(c, to, c->seqno, data, len);
+    }
+    if (opts && opts->ack && c->cb->acked) {
+      c->cb->acked(c, to, c->seqno);
+    }
+    c->seqno += n;
+    return 1;
+  }
+  // make room for all of them first, so they do not evict one another
+  dtn_store_purge(&c->store);
+  while (c->store.size - c->store.len < n
+         && c->store.drop != DTN_DROP_NONE && c->store.len > 0) {
+    dtn_store_evict(&c->store);
+  }
+  if (c->store.size - c->store.len < n) {
+    IMPT("dtn_send_bulk: no room for %d fragments.\n", n);
+    DTN_STAT(c, enqueue_failed);
+    return 0;
+  }
+  struct dtn_hdr hdr;
+  uint16_t base = c->seqno;
+  dtn_opts_hdr(c, &hdr, to, opts);
+  hdr.flags |= DTN_FLAG_FRAG;
+  hdr.frag_count = n;
+  for (i = 0; i < n; i++) {
+    packetbuf_copyfrom((const uint8_t *)data + (uint16_t)i * DTN_FRAG_SIZE,
+                       i + 1 < n ? DTN_FRAG_SIZE : len - i * DTN_FRAG_SIZE);
+    hdr.frag_index = i;
+    if (!dtn_originate(c, &hdr)) {
+      while (i-- > 0) { // a message short of a fragment is of no use
+        struct dtn_bundle *b = dtn_store_find(&c->store, &rimeaddr_node_addr,
+                                              base + i);
+        if (b) dtn_store_remove(&c->store, b);
+      }
+      return 0;
+    }
+  }
+  return 1;
+#else
+  IMPT("dtn_send_bulk: fragmentation disabled.\n");
+  return 0;
+#endif
+}
+/*---------------------------------------------------------------------------*/
+int
+dtn_send_group(struct dtn_conn *c, uint8_t group, uint8_t members,
+               const struct dtn_send_opts *opts)
+{
+#if DTN_GROUPS
+  if (members > DTN_GROUP_MEMBERS) {
+    IMPT("dtn_send_group: %d members cannot be told apart.\n", members);
+    return 0;
+  }
+  struct dtn_hdr hdr;
+  rimeaddr_t to;
+  dtn_group_addr(&to, group);
+  dtn_opts_hdr(c, &hdr, &to, opts);
+  hdr.flags |= DTN_FLAG_GROUP;
+  hdr.members = members;
+  return dtn_originate(c, &hdr);
+#else
+  IMPT("dtn_send_group: groups disabled.\n");
+  return 0;
+#endif
+}
+/*---------------------------------------------------------------------------*/
+int
+dtn_join(struct dtn_conn *c, uint8_t group)
+{
+#if DTN_GROUPS
+  uint8_t i;
+  for (i = 0; i < c->groups_len; i++) {
+    if (c->groups[i] == group) return 1;
+  }
+  if (c->groups_len == DTN_GROUPS) {
+    IMPT("dtn_join: no room for group %d.\n", group);
+    return 0;
+  }
+  c->groups[c->groups_len++] = group;
+  return 1;
+#else
+  return 0;
+#endif
+}
+/*---------------------------------------------------------------------------*/
+void
+dtn_leave(struct dtn_conn *c, uint8_t group)
+{
+#if DTN_GROUPS
+  uint8_t i;
+  for (i = 0; i < c->groups_len; i++) {
+    if (c->groups[i] == group) {
+      c->groups[i] = c->groups[--c->groups_len];
+      return;
+    }
+  }
+#endif
+}
+/*---------------------------------------------------------------------------*/
+void
+dtn_group_addr(rimeaddr_t *addr, uint8_t group)
+{
+  memset(addr, 0xff, sizeof(rimeaddr_t));
+  addr->u8[0] = group;
+}
+/*---------------------------------------------------------------------------*/
+int
+dtn_is_group(const rimeaddr_t *addr)
+{
+  uint8_t i;
+  for (i = 1; i < sizeof(rimeaddr_t); i++) {
+    if (addr->u8[i] != 0xff) return 0;
+  }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+void
+dtn_set_lifetime(struct dtn_conn *c, uint16_t lifetime)
+{
+  c->lifetime = lifetime < DTN_MAX_LIFETIME ? lifetime : DTN_MAX_LIFETIME;
+}
+/*---------------------------------------------------------------------------*/
+void
+dtn_set_policy(struct dtn_conn *c, uint8_t drop, uint8_t order)
+{
+  dtn_store_set_policy(&c->store, drop, order);
+  IMPT("dtn_set_policy: Drop policy %d, spray order %d.\n", drop, order);
+}
+/*---------------------------------------------------------------------------*/
+void
+dtn_get_stats(struct dtn_conn *c, struct dtn_stats *stats)
+{
+#if DTN_STATS
+  memcpy(stats, &c->stats, sizeof(struct dtn_stats));
+#else
+  memset(stats, 0, sizeof(struct dtn_stats));
+#endif
+}
+/*---------------------------------------------------------------------------*/
+void
+dtn_get_energy(struct dtn_conn *c, struct dtn_energy *energy)
+{
+#if DTN_ENERGY
+  memcpy(energy, &c->energy, sizeof(struct dtn_energy));
+#else
+  memset(energy, 0, sizeof(struct dtn_energy));
+#endif
+}
+/*---------------------------------------------------------------------------*/
+void
+dtn_reset_stats(struct dtn_conn *c)
+{
+#if DTN_STATS
+  memset(&c->stats, 0, sizeof(struct dtn_stats));
+  c->stats.queue_hwm = c->store.len;
+#endif
+#if DTN_ENERGY
+  memset(&c->energy, 0, sizeof(struct dtn_energy));
+#endif
+}
+/*---------------------------------------------------------------------------*/
+uint16_t
+dtn_trace_drain(struct dtn_conn *c, struct dtn_trace_rec *recs, uint16_t max)
+{
+  uint16_t n = 0;
+#if DTN_TRACE
+  while (n < max && c->trace_len > 0) {
+    memcpy(&recs[n++], &c->trace[c->trace_head], sizeof(struct dtn_trace_rec));
+    c->trace_head = (c->trace_head + 1) % DTN_TRACE;
+    c->trace_len--;
+  }
+#endif
+  return n;
 }
 /*---------------------------------------------------------------------------*/
 void
@@ -12,7 +12,269 @@
  * \example example-dtn.c
  * 
  * \section channels Channels
- *     The DTN module uses 3 channels (for spray, request and hand-off).
+ *     The DTN module uses 2 + #DTN_HANDOFFS channels (for spray, request and
+ *     one per concurrent hand-off), so #DTN_HANDOFFS must be the same on
+ *     every node. Version 1 used 3, and with the default of 4 hand-offs a
+ *     connection now reserves 6: channels up to dtn_channel + 5 must be
+ *     kept free of other connections, where dtn_channel + 3 and beyond used
+ *     to be available.
+ *     The first hand-off stays on dtn_channel + 2, the only hand-off channel
+ *     version 1 nodes listen on, and a peer not known to be upgraded, see
+ *     \ref wire, is only ever handed bundles there.
+ * 
+ * \section wire Header format
+ *     Message headers are serialised field by field rather than sent as
+ *     struct \ref dtn_hdr. The first byte holds the header version in its
+ *     top 3 bits, the priority in the next 2 and one bit for each optional
+ *     field, the second the L value. The origin, destination and sequence
+ *     number follow, then the lifetime, encounter age and flags when they
+ *     are not 0, 0xffff and 0 respectively, the index and count of a
+ *     fragment, the member count of a group bundle, see \ref groups, and
+ *     the room left in the sender's store, see \ref congestion, 8 to 18
+ *     bytes in all with 2-byte addresses.
+ *     Multi-byte fields are big-endian.
+ * 
+ *     The version 1 nodes already deployed send the struct they had then
+ *     itself: version, magic "SW", L value, origin, destination and
+ *     sequence number, 12 bytes with its padding and in their own byte
+ *     order, told apart by the version 1 in the first byte, whose top bits
+ *     are 0. With #DTN_HDR_COMPAT set, nodes still decode that raw header,
+ *     taking the lifetime as #DTN_MAX_LIFETIME, and learn from each
+ *     neighbour which of the two it sends. Requests and hand-offs answer a
+ *     raw frame with a raw one unless the neighbour is known to understand
+ *     packed headers, and sprays are raw, and never advertisements, while a
+ *     neighbour known only to send raw headers is around. A raw header has
+ *     no room for the lifetime, priority, encounter age or flags, so they
+ *     are lost on the way through a version 1 node, and fragments and group
+ *     bundles are never sent to one. A raw request is followed by "SP"
+ *     where version 1 nodes repeat the message, telling that the requester
+ *     understands packed headers, so two upgraded nodes switch on their
+ *     first exchange.
+ * 
+ * \section frag Fragmentation
+ *     With #DTN_FRAG_MAX set, dtn_send_bulk() sends messages longer than one
+ *     packet buffer as up to #DTN_FRAG_MAX fragments of #DTN_FRAG_SIZE
+ *     bytes. Each fragment is a bundle of its own, with the next sequence
+ *     number, that carries its index and the number of fragments after the
+ *     flags, so fragments are sprayed, requested and hand-offed on their
+ *     own and at once. The destination copies them into one of
+ *     #DTN_REASSEMBLY buffers as they come and calls the recv_bulk callback
+ *     once it has them all. A fragment is only confirmed to its sprayer
+ *     once a buffer took it, so with every buffer busy it is sprayed again
+ *     later. The last #DTN_REASM_DONE messages passed on are remembered, so
+ *     late copies of their fragments do not start them over.
+ *     Delivered fragments are tombstoned like any bundle, so only the
+ *     missing ones keep travelling. Fragments are never
+ *     sent to version 1 nodes, and #DTN_FRAG_SIZE must be the same on every
+ *     node.
+ * 
+ * \section pools Bundle pools
+ *     Each connection keeps its bundles and their index in a struct
+ *     \ref dtn_pool of its own, so connections on different channels do
+ *     not share buffers and each can have its own capacity and drop policy.
+ *     dtn_open() uses a pool of #DTN_QUEUE_MAX bundles inside struct
+ *     \ref dtn_conn, dtn_open_pool() one declared with DTN_POOL().
+ *     With #DTN_STORE_CFS each pool has a file of its own: the one of
+ *     dtn_open() is named after its channel, so connections opened with it
+ *     on different channels keep their bundles apart, and a DTN_POOL() is
+ *     named after the pool.
+ * 
+ * \section tx Transmit queue
+ *     Frames are not sent from the receive callbacks or the spray timer but
+ *     queued, and sent one at a time after a short random delay, so sending
+ *     never busy-waits and neighbours answering the same frame do not
+ *     collide. Frames are built when sent, from the bundle store, so the
+ *     queue holds no copies of them: a spray or hand-off only holds the
+ *     index of its bundle or hand-off slot, and a request the origin and
+ *     sequence number of the bundle it asks for. A spray round takes one
+ *     entry that sprays the ready bundles one after the other, so
+ *     #DTN_TX_QUEUE does not grow with the pool.
+ * 
+ * \section copies Message copies
+ *     A message is copied into the store once, and out of it once per
+ *     frame: sprays and hand-offs decode the stored header where it lies
+ *     and copy the message from its queue buffer, or the store file, into
+ *     the packet buffer, where the frame is built. A hand-off of a single
+ *     bundle is stored from the packet buffer it arrived in. dtn_send_iov()
+ *     gathers a message from its pieces straight into the packet buffer,
+ *     and the recv_data callback gets the message where it lies in it.
+ * 
+ * \section trickle Spray interval
+ *     Ready bundles are sprayed once per interval, at a random point in its
+ *     second half, Trickle-style. The interval starts at #DTN_SPRAY_DELAY and
+ *     doubles, up to #DTN_SPRAY_DOUBLINGS times, while nothing changes. It
+ *     drops back to #DTN_SPRAY_DELAY when a bundle is stored, a neighbour
+ *     asks for one, or a neighbour not heard from recently shows up. A spray
+ *     is skipped when #DTN_SPRAY_REDUNDANCY neighbours were heard spraying
+ *     bundles we hold during the interval, unless a neighbour asked for
+ *     one of ours.
+ * 
+ * \section contacts Contact-triggered spraying
+ *     With #DTN_BEACON set, nodes broadcast a beacon of three bytes every
+ *     #DTN_BEACON seconds, and neighbours not heard from for three beacon
+ *     intervals are gone. Sprays are then held back while no neighbour is
+ *     around, instead of going out every interval to nobody, and a
+ *     neighbour showing up gets all the ready bundles sprayed at once
+ *     rather than at the next interval. #DTN_BEACON must be the same on
+ *     every node, or silent neighbours are missed.
+ * 
+ * \section adverts Spray advertisements
+ *     With #DTN_SPRAY_ADV set, sprays carry only bundle descriptors, many
+ *     per frame, and the payload travels in the hand-off after a request,
+ *     including to the destination. Nodes always understand both kinds of
+ *     spray, so the setting can differ across a fleet. A descriptor is the
+ *     origin, destination, sequence number, L value and encounter age, in
+ *     network byte order like the packed header. A node asks for an
+ *     advertised bundle at most once per two spray intervals, whoever
+ *     advertises it, and a relay does not ask for a copy when the
+ *     advertiser heard the destination within the last #DTN_SPRAY_DELAY
+ *     seconds, as the destination asks for it itself. Adverts pay off where
+ *     bundles wait in stores and are sprayed over and over: with 80-byte
+ *     messages they halve the bytes on air of the random waypoint and grid
+ *     benchmarks. In a full mesh, where one spray reaches the destination,
+ *     the extra request and acknowledgement cost about as much as they
+ *     save.
+ * 
+ * \section batch Batched exchanges
+ *     With #DTN_BATCH above 1, requests queued for the same neighbour go
+ *     out as one naming up to #DTN_BATCH bundles, and the sprayer answers
+ *     with one hand-off carrying as many of them as fit in a packet buffer,
+ *     acknowledged and retransmitted as a whole. A contact then takes one
+ *     round trip for several bundles instead of one each. As the sprays of
+ *     a round arrive one by one, a request waits up to #DTN_BATCH transmit
+ *     slots of about 1/64 s for the next ones to the same neighbour, unless
+ *     #DTN_BATCH of them are queued already. A batched request
+ *     has the batch flag set and lists the origin, sequence number and
+ *     encounter age of the further bundles after its header, and each
+ *     bundle of a batched hand-off has the flag set and its payload length
+ *     in the byte after its header. Older nodes ignore the list and answer
+ *     the first bundle only, and hand-offs are only batched to neighbours
+ *     whose request was, so the setting can differ across a fleet.
+ * 
+ * \section congestion Congestion-aware spraying
+ *     With #DTN_CONGESTION set, nodes tell their neighbours how much room
+ *     their bundle store has left: sprays and requests carry the number of
+ *     free slots and the share of the store in use after the flags of their
+ *     header, and beacons and advertisements in two bytes after the frame,
+ *     which older nodes ignore. A node whose store is at least
+ *     #DTN_CONGESTION percent full does not ask a neighbour with an emptier
+ *     one for relay copies, as it would only push out a bundle it holds to
+ *     take one the neighbour has room for. A node serving a request gives
+ *     the requester, instead of half its copies, a share in proportion to
+ *     how much emptier the requester's store is than its own, still half
+ *     when both are as full, and a single copy if the requester had no
+ *     slot left. Copies thus flow from hot relays to idle ones. Neighbours
+ *     that advertised nothing get half, as before.
+ * 
+ *     Whether this pays depends on what a full store costs. With
+ *     #DTN_DROP_NONE relays that turn bundles away waste the hand-offs
+ *     sent to them, and steering copies elsewhere saves those. A store
+ *     that drops its oldest bundles makes room for fresh ones at the
+ *     expense of stale ones, and holding back then tends to cost
+ *     deliveries.
+ * 
+ * \section sv Summary vectors
+ *     With #DTN_SUMMARY_VECTORS set, nodes broadcast a Bloom filter of the
+ *     bundles they hold or have had delivered when they hear a neighbour
+ *     offer something they already have. A bundle that every neighbour
+ *     heard from recently already holds is not sprayed. The filters only
+ *     hold back sprays and offers, never a delivery, as a false positive
+ *     would lose the bundle; tombstones catch duplicates exactly.
+ * 
+ * \section focus Spray and focus
+ *     A node left with the last copy of a bundle does not just wait to meet
+ *     its destination. With #DTN_FOCUS set, sprays and adverts carry how
+ *     long ago the sender last heard from the destination, and a neighbour
+ *     that heard from it at least #DTN_FOCUS_THRESHOLD seconds more recently
+ *     asks for the copy, which is handed over after the same check. The
+ *     times come from the table of recent neighbours, so only direct
+ *     encounters count.
+ * 
+ * \section stats Statistics
+ *     With #DTN_STATS set, each connection counts sprays, requests,
+ *     hand-offs, deliveries and store drops in a struct \ref dtn_stats, at
+ *     the cost of one increment per event, so unlike the debug output it can
+ *     stay on in production. dtn_get_stats() takes a snapshot and
+ *     dtn_reset_stats() starts the counters over.
+ * 
+ * \section energy Energy and transmit power
+ *     With #DTN_ENERGY set, each connection reads the radio transmit time
+ *     from Energest around every frame it sends and adds it to the spray,
+ *     request or hand-off phase in a struct \ref dtn_energy, hand-offs
+ *     counting once more per runicast retransmission. Sprays include the
+ *     advertisements, summary vectors, tombstones and beacons. Only the time
+ *     spent before the send returns is seen, all of it with nullrdc, so
+ *     Energest must be on and the MAC must not defer the frames.
+ *     dtn_get_energy() takes a snapshot, and dtn_reset_stats() starts it
+ *     over. Multiplied by the radio's transmit current at each power level,
+ *     it tells what each phase costs.
+ * 
+ *     With #DTN_POWER_CONTROL set, the connection sets the transmit power
+ *     itself instead of leaving it to dtn_set_power(). It starts at
+ *     #DTN_POWER_MAX and every #DTN_POWER_CONTROL seconds steps it down
+ *     while at least twice #DTN_POWER_DENSITY neighbours were heard and no
+ *     hand-off failed, and back up, twice as fast, while fewer than
+ *     #DTN_POWER_DENSITY were heard or more than a quarter of the hand-offs
+ *     timed out. Relays in dense spots thus trade range for battery life,
+ *     and isolated ones keep theirs. Fewer contacts mean fewer deliveries,
+ *     so the saving has a price, which the energy report of sim/dtn-sim
+ *     shows for a given scenario. Neighbours are only heard
+ *     when they send, so the controller works best with #DTN_BEACON set
+ *     below #DTN_POWER_CONTROL. The power is the radio's, so only one
+ *     connection per node should control it.
+ * 
+ * \section trace Event trace
+ *     With #DTN_TRACE set, each connection also records what happens to
+ *     every bundle, one struct \ref dtn_trace_rec per event, in a ring of
+ *     #DTN_TRACE records that overwrites the oldest ones. Recording costs a
+ *     copy of a few bytes and no output, so it does not change the timing
+ *     under observation. The application drains the ring with
+ *     dtn_trace_drain() and ships it off the node, and sim/dtn-trace merges
+ *     the traces of many nodes into per-bundle propagation trees.
+ *     Advertisements are not traced, the requests they trigger are.
+ * 
+ * \section lifetime Bundle lifetime
+ *     Bundles carry the seconds they have left to live, which each node
+ *     counts down while it holds them and sends along, so a bundle expires
+ *     at the same time everywhere however often it is forwarded. Expired
+ *     bundles are dropped when they would be sprayed, requested or
+ *     hand-offed, and are not accepted from neighbours.
+ * 
+ * \section policies Buffer policies
+ *     When a bundle arrives and the store is full, the drop policy picks a
+ *     stored bundle of the lowest priority to make room for it, or refuses
+ *     the new one with #DTN_DROP_NONE. Ready bundles are sprayed, advertised
+ *     and hand-offed by priority, and in spray order within a priority. The
+ *     drop policy and the spray order are set per connection with
+ *     dtn_set_policy(), and default to #DTN_DROP_POLICY and #DTN_SPRAY_ORDER.
+ * 
+ * \section tombstones Delivery tombstones
+ *     A destination passes each bundle to the application once, and
+ *     broadcasts a tombstone naming it. Nodes holding a copy drop it and
+ *     pass the tombstone on, and any node that knows a bundle was delivered
+ *     answers offers of it with a tombstone, so copies stop spreading.
+ *     Each tombstone carries the seconds its sender still remembers it, at
+ *     most #DTN_TOMB_LIFETIME, and is forgotten everywhere at about the
+ *     same time rather than passed back and forth.
+ * 
+ * \section groups Group destinations
+ *     With #DTN_GROUPS set, a message can be addressed to a group instead
+ *     of a node, so that one bundle, stored and sprayed once, serves every
+ *     member. dtn_join() adds the connection to a group, and
+ *     dtn_send_group() sends to one, along with the number of members it is
+ *     to reach. Group addresses are those dtn_group_addr() makes, whose
+ *     bytes but the first are all 0xff, so nodes must not use them.
+ * 
+ *     A member passes a group bundle to the application the first time it
+ *     hears of it, and answers with a request that has the group flag set,
+ *     which the sprayer takes as a delivery rather than as a request for
+ *     copies. Members do not announce tombstones for group bundles, as the
+ *     others may still need them. Each holder instead notes which members
+ *     it saw take the bundle, up to #DTN_GROUP_MEMBERS of them, and drops
+ *     the bundle as delivered once all of them have, announcing the
+ *     tombstone then. The header of a group bundle carries the group flag
+ *     and the member count after the fragment fields. Version 1 nodes
+ *     cannot carry it, so group bundles are never sent to them.
  * 
  * \file
  *     Header file for the \ref dtn module
@@ -23,17 +285,378 @@
 #define DTN_H
 #include "net/rime.h"
 
-#define DTN_VERSION 1
+#define DTN_VERSION 4
+
+#ifdef DTN_CONF_L_COPIES
+#define DTN_L_COPIES DTN_CONF_L_COPIES
+#else
 #define DTN_L_COPIES 8
+#endif
+
+/** Most copies a bundle may be sent with, see dtn_send_ex() */
+#ifdef DTN_CONF_MAX_COPIES
+#define DTN_MAX_COPIES DTN_CONF_MAX_COPIES
+#else
+#define DTN_MAX_COPIES (4 * DTN_L_COPIES)
+#endif
+
+#ifdef DTN_CONF_QUEUE_MAX
+#define DTN_QUEUE_MAX DTN_CONF_QUEUE_MAX
+#else
 #define DTN_QUEUE_MAX 5
+#endif
+
+/**
+ * Longest lifetime of a bundle in seconds, also the lifetime of the bundles
+ * sent without one
+ */
+#ifdef DTN_CONF_MAX_LIFETIME
+#define DTN_MAX_LIFETIME DTN_CONF_MAX_LIFETIME
+#else
 #define DTN_MAX_LIFETIME 60
+#endif
+
+/** Shortest spray interval in seconds */
+#ifdef DTN_CONF_SPRAY_DELAY
+#define DTN_SPRAY_DELAY DTN_CONF_SPRAY_DELAY
+#else
 #define DTN_SPRAY_DELAY 5
+#endif
+
+/** Times the spray interval may double while nothing changes */
+#ifdef DTN_CONF_SPRAY_DOUBLINGS
+#define DTN_SPRAY_DOUBLINGS DTN_CONF_SPRAY_DOUBLINGS
+#else
+#define DTN_SPRAY_DOUBLINGS 4
+#endif
+
+/**
+ * Sprays of bundles we hold heard in an interval after which our own spray
+ * is suppressed, 0 never suppresses
+ */
+#ifdef DTN_CONF_SPRAY_REDUNDANCY
+#define DTN_SPRAY_REDUNDANCY DTN_CONF_SPRAY_REDUNDANCY
+#else
+#define DTN_SPRAY_REDUNDANCY 2
+#endif
+
+/**
+ * Number of neighbours remembered to tell new ones apart, and to tell which
+ * of them met a destination most recently
+ */
+#ifdef DTN_CONF_NEIGHBOURS
+#define DTN_NEIGHBOURS DTN_CONF_NEIGHBOURS
+#else
+#define DTN_NEIGHBOURS 8
+#endif
+
+#ifdef DTN_CONF_RTX
+#define DTN_RTX DTN_CONF_RTX
+#else
 #define DTN_RTX 3
-#define DTN_HANDOFF_NUM_HISTORY_ENTRIES 4
+#endif
+
+/** Keep bundles in a CFS file, e.g. on Coffee, instead of queue buffers */
+#ifdef DTN_CONF_STORE_CFS
+#define DTN_STORE_CFS DTN_CONF_STORE_CFS
+#else
+#define DTN_STORE_CFS 0
+#endif
+
+/**
+ * Name of the CFS files of the bundle stores, followed by a dot and the
+ * channel, or the pool name for DTN_POOL(), see \ref pools
+ */
+#ifdef DTN_CONF_STORE_FILE
+#define DTN_STORE_FILE DTN_CONF_STORE_FILE
+#else
+#define DTN_STORE_FILE "dtn.store"
+#endif
+
+/* Priorities of the bundles, see dtn_send_ex() */
+#define DTN_PRIORITY_BULK 0       /**< Sprayed and kept last */
+#define DTN_PRIORITY_NORMAL 1     /**< Priority of dtn_send() */
+#define DTN_PRIORITY_EXPEDITED 2  /**< Sprayed and kept first */
+
+/* Drop policies of a full bundle store, see \ref policies */
+#define DTN_DROP_NONE 0           /**< Refuse new bundles when full */
+#define DTN_DROP_OLDEST 1         /**< Drop the bundle stored the longest */
+#define DTN_DROP_MOST_COPIES 2    /**< Drop the bundle with the highest L */
+#define DTN_DROP_NEAREST_EXPIRY 3 /**< Drop the bundle closest to expiry */
+
+/* Spray orders of the ready bundles */
+#define DTN_ORDER_FIFO 0          /**< Spray bundles in the order stored */
+#define DTN_ORDER_MOST_COPIES 1   /**< Spray the highest L first */
+#define DTN_ORDER_NEAREST_EXPIRY 2 /**< Spray the closest to expiry first */
+
+/** Default drop policy of a full bundle store */
+#ifdef DTN_CONF_DROP_POLICY
+#define DTN_DROP_POLICY DTN_CONF_DROP_POLICY
+#else
+#define DTN_DROP_POLICY DTN_DROP_OLDEST
+#endif
+
+/** Default order in which ready bundles are sprayed */
+#ifdef DTN_CONF_SPRAY_ORDER
+#define DTN_SPRAY_ORDER DTN_CONF_SPRAY_ORDER
+#else
+#define DTN_SPRAY_ORDER DTN_ORDER_FIFO
+#endif
+
+#ifdef DTN_CONF_STORE_INDEX_SIZE
+#define DTN_STORE_INDEX_SIZE DTN_CONF_STORE_INDEX_SIZE
+#else
+#define DTN_STORE_INDEX_SIZE DTN_QUEUE_MAX
+#endif
+
+/** Spray bundle descriptors only, instead of whole bundles */
+#ifdef DTN_CONF_SPRAY_ADV
+#define DTN_SPRAY_ADV DTN_CONF_SPRAY_ADV
+#else
+#define DTN_SPRAY_ADV 0
+#endif
+
+/** Maximum number of bundle descriptors in one spray advertisement */
+#ifdef DTN_CONF_ADV_MAX_ENTRIES
+#define DTN_ADV_MAX_ENTRIES DTN_CONF_ADV_MAX_ENTRIES
+#else
+#define DTN_ADV_MAX_ENTRIES 10
+#endif
+
+/** Exchange summary vectors and only spray what neighbours lack */
+#ifdef DTN_CONF_SUMMARY_VECTORS
+#define DTN_SUMMARY_VECTORS DTN_CONF_SUMMARY_VECTORS
+#else
+#define DTN_SUMMARY_VECTORS 1
+#endif
+
+/** Size of a summary vector in bits, a multiple of 8 */
+#ifdef DTN_CONF_SV_BITS
+#define DTN_SV_BITS DTN_CONF_SV_BITS
+#else
+#define DTN_SV_BITS 128
+#endif
+
+/** Number of hash functions of the summary vector Bloom filter */
+#ifdef DTN_CONF_SV_HASHES
+#define DTN_SV_HASHES DTN_CONF_SV_HASHES
+#else
+#define DTN_SV_HASHES 2
+#endif
+
+/** Number of neighbours whose summary vectors are kept */
+#ifdef DTN_CONF_SV_NEIGHBOURS
+#define DTN_SV_NEIGHBOURS DTN_CONF_SV_NEIGHBOURS
+#else
+#define DTN_SV_NEIGHBOURS 8
+#endif
+
+/** Seconds a neighbour's summary vector is trusted */
+#ifdef DTN_CONF_SV_LIFETIME
+#define DTN_SV_LIFETIME DTN_CONF_SV_LIFETIME
+#else
+#define DTN_SV_LIFETIME (4 * DTN_SPRAY_DELAY)
+#endif
+
+/** Number of delivered bundles remembered, 0 disables delivery tombstones */
+#ifdef DTN_CONF_TOMBSTONES
+#define DTN_TOMBSTONES DTN_CONF_TOMBSTONES
+#else
+#define DTN_TOMBSTONES 8
+#endif
+
+/** Seconds a delivered bundle is remembered */
+#ifdef DTN_CONF_TOMB_LIFETIME
+#define DTN_TOMB_LIFETIME DTN_CONF_TOMB_LIFETIME
+#else
+#define DTN_TOMB_LIFETIME DTN_MAX_LIFETIME
+#endif
+
+/**
+ * Number of hand-offs in flight at once, each on its own channel after the
+ * request one, see \ref channels
+ */
+#ifdef DTN_CONF_HANDOFFS
+#define DTN_HANDOFFS DTN_CONF_HANDOFFS
+#else
+#define DTN_HANDOFFS 4
+#endif
+
+/**
+ * Most bundles one request names and one hand-off carries, 1 requests and
+ * hand-offs them one by one
+ */
+#ifdef DTN_CONF_BATCH
+#define DTN_BATCH DTN_CONF_BATCH
+#else
+#define DTN_BATCH 1
+#endif
+
+/**
+ * Percentage of its bundle store in use from which a node takes no relay
+ * copies from neighbours with emptier ones, 0 to leave the stores out of
+ * hand-offs, see \ref congestion
+ */
+#ifdef DTN_CONF_CONGESTION
+#define DTN_CONGESTION DTN_CONF_CONGESTION
+#else
+#define DTN_CONGESTION 0
+#endif
+
+/** Groups a connection can join, 0 leaves group destinations out */
+#ifdef DTN_CONF_GROUPS
+#define DTN_GROUPS DTN_CONF_GROUPS
+#else
+#define DTN_GROUPS 0
+#endif
+
+/**
+ * Members of a group whose delivery a holder of a group bundle notes,
+ * bundles sent to larger groups are sprayed until they expire
+ */
+#ifdef DTN_CONF_GROUP_MEMBERS
+#define DTN_GROUP_MEMBERS DTN_CONF_GROUP_MEMBERS
+#else
+#define DTN_GROUP_MEMBERS 4
+#endif
+
+/**
+ * Number of frames waiting to be transmitted: the hand-offs, the requests
+ * for the sprays heard, and a spray round, advertisement, summary vector
+ * and beacon. The same whatever the size of the pool, see \ref tx
+ */
+#ifdef DTN_CONF_TX_QUEUE
+#define DTN_TX_QUEUE DTN_CONF_TX_QUEUE
+#else
+#define DTN_TX_QUEUE (DTN_HANDOFFS + 8)
+#endif
+
+/** Hand the last copy of a bundle to neighbours closer to its destination */
+#ifdef DTN_CONF_FOCUS
+#define DTN_FOCUS DTN_CONF_FOCUS
+#else
+#define DTN_FOCUS 1
+#endif
+
+/**
+ * Seconds a neighbour must have met the destination more recently than us to
+ * be handed the last copy of a bundle
+ */
+#ifdef DTN_CONF_FOCUS_THRESHOLD
+#define DTN_FOCUS_THRESHOLD DTN_CONF_FOCUS_THRESHOLD
+#else
+#define DTN_FOCUS_THRESHOLD (2 * DTN_SPRAY_DELAY)
+#endif
+
+/** Count protocol events, see dtn_get_stats() */
+#ifdef DTN_CONF_STATS
+#define DTN_STATS DTN_CONF_STATS
+#else
+#define DTN_STATS 1
+#endif
+
+/**
+ * Understand the raw header of version 1 nodes, and keep sending it to
+ * them, see \ref wire
+ */
+#ifdef DTN_CONF_HDR_COMPAT
+#define DTN_HDR_COMPAT DTN_CONF_HDR_COMPAT
+#else
+#define DTN_HDR_COMPAT 1
+#endif
+
+/**
+ * Seconds between neighbour discovery beacons, 0 disables them, see
+ * \ref contacts
+ */
+#ifdef DTN_CONF_BEACON
+#define DTN_BEACON DTN_CONF_BEACON
+#else
+#define DTN_BEACON 0
+#endif
+
+/**
+ * Account radio transmit time per phase with Energest, see \ref energy and
+ * dtn_get_energy()
+ */
+#ifdef DTN_CONF_ENERGY
+#define DTN_ENERGY DTN_CONF_ENERGY
+#else
+#define DTN_ENERGY 0
+#endif
+
+/**
+ * Seconds between transmit power adjustments, 0 leaves the power to
+ * dtn_set_power(), see \ref energy
+ */
+#ifdef DTN_CONF_POWER_CONTROL
+#define DTN_POWER_CONTROL DTN_CONF_POWER_CONTROL
+#else
+#define DTN_POWER_CONTROL 0
+#endif
+
+/** Neighbours the power controller keeps in range */
+#ifdef DTN_CONF_POWER_DENSITY
+#define DTN_POWER_DENSITY DTN_CONF_POWER_DENSITY
+#else
+#define DTN_POWER_DENSITY 4
+#endif
+
+/** Number of events kept for dtn_trace_drain(), 0 disables the trace */
+#ifdef DTN_CONF_TRACE
+#define DTN_TRACE DTN_CONF_TRACE
+#else
+#define DTN_TRACE 0
+#endif
+
+/**
+ * Number of fragments a message sent with dtn_send_bulk() may have, at most
+ * the size of the bundle pool, 0 disables fragmentation, see \ref frag
+ */
+#ifdef DTN_CONF_FRAG_MAX
+#define DTN_FRAG_MAX DTN_CONF_FRAG_MAX
+#else
+#define DTN_FRAG_MAX 0
+#endif
+
+/** Bytes of message in every fragment but the last */
+#ifdef DTN_CONF_FRAG_SIZE
+#define DTN_FRAG_SIZE DTN_CONF_FRAG_SIZE
+#else
+#define DTN_FRAG_SIZE 64
+#endif
+
+/** Number of fragmented messages reassembled at once */
+#ifdef DTN_CONF_REASSEMBLY
+#define DTN_REASSEMBLY DTN_CONF_REASSEMBLY
+#else
+#define DTN_REASSEMBLY 1
+#endif
+
+/* Events of the trace, see struct dtn_trace_rec */
+#define DTN_TRACE_SEND 0          /**< Bundle created, peer is its
+                                       destination */
+#define DTN_TRACE_SPRAY_TX 1      /**< Bundle sprayed */
+#define DTN_TRACE_SPRAY_RX 2      /**< Spray heard from peer */
+#define DTN_TRACE_REQUEST_TX 3    /**< Request sent to peer */
+#define DTN_TRACE_REQUEST_RX 4    /**< Request received from peer */
+#define DTN_TRACE_HANDOFF_TX 5    /**< Hand-off of L copies started to peer */
+#define DTN_TRACE_HANDOFF_ACKED 6 /**< Hand-off acknowledged by peer */
+#define DTN_TRACE_HANDOFF_TIMEDOUT 7 /**< Hand-off to peer given up */
+#define DTN_TRACE_HANDOFF_RX 8    /**< Hand-off of L copies from peer */
+#define DTN_TRACE_DELIVER 9       /**< Bundle passed to the application */
+#define DTN_TRACE_DUPLICATE 10    /**< Bundle received again here at its
+                                       destination */
+#define DTN_TRACE_EXPIRE 11       /**< Bundle dropped as expired */
+#define DTN_TRACE_EVICT 12        /**< Bundle dropped by the drop policy */
 
 #define DTN_POWER_MAX 0x12
 #define DTN_POWER_MIN 0x00
 
+#define DTN_GROUP_SEEN 8 /**< Group bundles a member remembers delivering */
+#define DTN_REASM_DONE 8 /**< Reassembled messages a node remembers passing on */
+#define DTN_ADV_ASKED 8 /**< Advertised bundles a node remembers asking for */
+
 struct dtn_conn;
 struct dtn_hdr;
 
@@ -41,31 +664,470 @@ struct dtn_hdr;
 struct dtn_callbacks {
   /** Called when receiving a message from the \ref dtn "DTN" connections */
   void (* recv)(struct dtn_conn *c, const rimeaddr_t *from, uint16_t packetid);
+  /**
+   * Called when a message sent with a delivery ack requested reached its
+   * destination, may be NULL
+   */
+  void (* acked)(struct dtn_conn *c, const rimeaddr_t *to, uint16_t packetid);
+  /**
+   * Called when all the fragments of a message sent with dtn_send_bulk()
+   * arrived, with the sequence number of the first one, may be NULL
+   */
+  void (* recv_bulk)(struct dtn_conn *c, const rimeaddr_t *from,
+                     uint16_t packetid, const uint8_t *data, uint16_t len);
+  /**
+   * Called instead of recv if not NULL, with the message where it lies in
+   * the packet buffer
+   */
+  void (* recv_data)(struct dtn_conn *c, const rimeaddr_t *from,
+                     uint16_t packetid, const uint8_t *data, uint16_t len);
 };
 
-/** Structure for \ref dtn "DTN" message header */
+/** Options of a message sent with dtn_send_ex() */
+struct dtn_send_opts {
+  uint16_t num_copies;            /**< Number of copies (The L value), at most
+                                       #DTN_MAX_COPIES, 0 for #DTN_L_COPIES */
+  uint16_t lifetime;              /**< Seconds before the message expires, 0
+                                       for the one of dtn_set_lifetime() */
+  uint8_t priority;               /**< One of the DTN_PRIORITY_ values,
+                                       higher ones are taken as
+                                       #DTN_PRIORITY_EXPEDITED */
+  uint8_t ack;                    /**< Non-zero to have the acked callback
+                                       called once the message is
+                                       delivered */
+};
+
+/** A piece of a message sent with dtn_send_iov() */
+struct dtn_iov {
+  const void *data;               /**< The bytes of the piece */
+  uint16_t len;                   /**< Their number */
+};
+
+/**
+ * Header of a \ref dtn "DTN" message, as decoded from the wire, see
+ * \ref wire
+ */
 struct dtn_hdr {
+  uint8_t version;                /**< Header format it was received in */
+  uint16_t num_copies;            /**< Number of copies (The L value) */
+  rimeaddr_t esender;             /**< Origin's address */
+  rimeaddr_t ereceiver;           /**< Destination's address */
+  uint16_t epacketid;             /**< Message's sequence number */
+  uint16_t lifetime;              /**< Seconds left before the message
+                                       expires */
+  uint8_t priority;               /**< One of the DTN_PRIORITY_ values */
+  uint8_t flags;                  /**< Delivery ack requested, or the message
+                                       is one */
+  uint16_t encounter;             /**< Seconds since the sender, or in a
+                                       request the requester, last heard from
+                                       the destination, 0xffff if never */
+  uint8_t frag_index;             /**< Index of the fragment, see \ref frag */
+  uint8_t frag_count;             /**< Fragments of the message, 0 if it is
+                                       not fragmented */
+  uint8_t members;                /**< Members of the group it is addressed
+                                       to, see \ref groups */
+#if DTN_CONGESTION
+  uint8_t room;                   /**< Free slots in the sender's store,
+                                       0xff if not advertised, see
+                                       \ref congestion */
+  uint8_t load;                   /**< Share of the sender's store in use,
+                                       in 256ths */
+#endif
+};
+
+/** Header of a \ref dtn "DTN" spray advertisement */
+struct dtn_adv_hdr {
   uint8_t version;                /**< DTN protocol version */
-  uint8_t magic[2];               /**< magic bytes defined in DTN protocol */
+  uint8_t magic[2];               /**< magic bytes, "SA" for advertisements */
+  uint8_t count;                  /**< Number of descriptors that follow */
+};
+
+/** Bundle descriptor in a \ref dtn "DTN" spray advertisement, as decoded.
+    On the air the fields follow each other in this order in network byte
+    order, with the L value in one byte. */
+struct dtn_adv_entry {
+  rimeaddr_t esender;             /**< Origin's address */
+  rimeaddr_t ereceiver;           /**< Destination's address */
+  uint16_t epacketid;             /**< Message's sequence number */
   uint16_t num_copies;            /**< Number of copies (The L value) */
+  uint16_t encounter;             /**< Seconds since the sender last heard
+                                       from the destination, 0xffff if
+                                       never */
+};
+
+/** \ref dtn "DTN" summary vector frame */
+struct dtn_sv_hdr {
+  uint8_t version;                /**< DTN protocol version */
+  uint8_t magic[2];               /**< magic bytes, "SV" for summary vectors */
+  uint8_t bits[DTN_SV_BITS / 8];  /**< Bloom filter over (esender, epacketid) */
+};
+
+/** Summary vector heard from a neighbour */
+struct dtn_sv_neighbour {
+  rimeaddr_t addr;                /**< Neighbour's address, null if unused */
+  struct timer lifetime;          /**< Trusted until expired */
+  uint8_t bits[DTN_SV_BITS / 8];  /**< The neighbour's Bloom filter */
+};
+
+/** A \ref dtn "DTN" neighbour discovery beacon */
+struct dtn_beacon_hdr {
+  uint8_t version;                /**< DTN protocol version */
+  uint8_t magic[2];               /**< magic bytes, "SB" for beacons */
+};
+
+/** Header of a \ref dtn "DTN" delivery tombstone (anti-packet) */
+struct dtn_tomb_hdr {
+  uint8_t version;                /**< DTN protocol version */
+  uint8_t magic[2];               /**< magic bytes, "SD" for tombstones */
+  uint8_t count;                  /**< Number of entries that follow */
+};
+
+/** Delivered bundle named in a \ref dtn "DTN" tombstone, as decoded. On
+    the air the fields follow each other in this order in network byte
+    order. */
+struct dtn_tomb_entry {
+  rimeaddr_t esender;             /**< Origin's address */
+  uint16_t epacketid;             /**< Message's sequence number */
+  uint16_t lifetime;              /**< Seconds before the sender forgets
+                                       it */
+};
+
+/** A bundle known to have reached its destination */
+struct dtn_tombstone {
+  rimeaddr_t esender;             /**< Origin's address */
+  uint16_t epacketid;             /**< Message's sequence number */
+  struct timer lifetime;          /**< Forgotten once expired */
+  uint8_t fresh;                  /**< To be announced to the neighbours */
+};
+
+/** A message held in the bundle store of a \ref dtn "DTN" connection */
+struct dtn_bundle {
+  struct dtn_bundle *hnext;       /**< Next bundle in the same index bucket,
+                                       or in the free list */
+  struct dtn_bundle *rprev;       /**< Previous bundle in the ready list */
+  struct dtn_bundle *rnext;       /**< Next bundle in the ready list */
+#if !DTN_STORE_CFS
+  struct queuebuf *qb;            /**< The message, DTN header included */
+#endif
+  struct timer lifetime;          /**< Dropped from the store once expired */
   rimeaddr_t esender;             /**< Origin's address */
   rimeaddr_t ereceiver;           /**< Destination's address */
   uint16_t epacketid;             /**< Message's sequence number */
+  uint16_t num_copies;            /**< Number of copies held (The L value),
+                                       the header in qb is not updated, nor
+                                       is its lifetime */
+  uint8_t state;                  /**< Free, pending or ready */
+  uint8_t priority;               /**< One of the DTN_PRIORITY_ values */
+#if DTN_GROUPS
+  uint8_t members;                /**< Members of its group, 0 if it is not
+                                       addressed to one */
+  uint8_t covered_len;            /**< Members seen to have it */
+  rimeaddr_t covered[DTN_GROUP_MEMBERS]; /**< Those members */
+#endif
+};
+
+/**
+ * Bundle store of a \ref dtn "DTN" connection. Bundles are indexed on
+ * (esender, epacketid), and the ones that can be sprayed (ready, with L > 0)
+ * are also linked in the ready list, in spray order, so neither lookups nor
+ * spraying walk the whole store.
+ *
+ * With #DTN_STORE_CFS set the messages are kept in slots of the file of
+ * the pool instead, slot i holding bundles[i], and only this index stays in
+ * RAM. The file is read back when the connection is opened,
+ * so stored bundles survive a reboot, with the lifetime they had when
+ * stored.
+ */
+struct dtn_store {
+  struct dtn_bundle *bundles;     /**< Bundles of the pool */
+  struct dtn_bundle **index;      /**< Hash buckets */
+  uint16_t size;                  /**< Number of bundles */
+  uint16_t index_size;            /**< Number of hash buckets */
+  struct dtn_bundle *free;        /**< Free bundles */
+  struct dtn_bundle *ready;       /**< Head of the ready list */
+  struct dtn_bundle *cursor;      /**< Next ready bundle of the spray
+                                       round, NULL once sprayed */
+  struct dtn_bundle *ready_tail;  /**< Tail of the ready list */
+  uint16_t len;                   /**< Number of bundles in use */
+  uint8_t drop;                   /**< Drop policy when full */
+  uint8_t order;                  /**< Order of the ready list */
+#if DTN_STORE_CFS
+  int fd;                         /**< The CFS file, negative if not open */
+#endif
+};
+
+/**
+ * Memory of the bundle store of a \ref dtn "DTN" connection, see
+ * \ref pools. DTN_POOL() declares one statically.
+ */
+struct dtn_pool {
+  uint16_t size;                  /**< Number of bundles */
+  struct dtn_bundle *bundles;     /**< size bundles */
+  uint16_t index_size;            /**< Number of hash buckets */
+  struct dtn_bundle **index;      /**< index_size hash buckets */
+  const char *file;               /**< CFS file of the bundles, used with
+                                       #DTN_STORE_CFS */
+};
+
+/**
+ * Declare a struct \ref dtn_pool of size bundles, for dtn_open_pool(). Its
+ * CFS file is #DTN_STORE_FILE followed by a dot and the name, and no other
+ * connection may use it: a pool holds one connection's bundles, as the
+ * one of dtn_open() does. dtn_open() names its file after the channel
+ * instead, so two connections opened with it only share a file if they
+ * share a channel, and those would clash on the air anyway.
+ */
+#define DTN_POOL(name, size) \
+  static struct dtn_bundle name##_bundles[size]; \
+  static struct dtn_bundle *name##_index[size]; \
+  static struct dtn_pool name = {size, name##_bundles, size, name##_index, \
+                                 DTN_STORE_FILE "." #name}
+
+/** Header of a bundle slot in the CFS file of a bundle store */
+struct dtn_store_rec {
+  uint8_t magic;                  /**< DTN magic byte once the slot is used */
+  uint8_t state;                  /**< Free, pending or ready */
+  uint16_t num_copies;            /**< Number of copies held (The L value) */
+  uint16_t len;                   /**< Length of the message that follows */
+};
+
+/** A bundle of a hand-off */
+struct dtn_handoff_item {
+  struct dtn_bundle *b;           /**< Bundle being hand-offed */
+  rimeaddr_t esender;             /**< Origin of the bundle when sent */
+  uint16_t epacketid;             /**< Sequence number of the bundle when
+                                       sent */
+  uint16_t num_copies;            /**< Copies handed over, taken from the
+                                       bundle until the hand-off fails */
+};
+
+/** A hand-off in flight, of up to #DTN_BATCH bundles */
+struct dtn_handoff {
+  struct runicast_conn c;         /**< The runicast connection it uses */
+  struct dtn_conn *conn;          /**< The DTN connection it belongs to */
+  rimeaddr_t to;                  /**< Neighbour it is hand-offed to */
+  uint8_t version;                /**< Header format of the request */
+  uint8_t batch;                  /**< Whether the neighbour takes batches */
+  uint8_t len;                    /**< Bundles in it, 0 if the entry is
+                                       free */
+  struct dtn_handoff_item items[DTN_BATCH]; /**< Its bundles */
+#if DTN_ENERGY
+  uint16_t tx_time;               /**< Transmit time of its frame */
+#endif
+};
+
+/** A neighbour heard from recently */
+struct dtn_neighbour {
+  rimeaddr_t addr;                /**< Neighbour's address, null if unused */
+  clock_time_t heard;             /**< When it was last heard from */
+  uint8_t version;                /**< Newest header format it is known to
+                                       understand, 0xff if unknown */
+#if DTN_CONGESTION
+  uint8_t room;                   /**< Free slots in its store it
+                                       advertised, 0xff if unknown */
+  uint8_t load;                   /**< Share of its store in use it
+                                       advertised, in 256ths */
+#endif
+};
+
+/** A frame in the transmit queue, built when it is sent, see \ref tx */
+struct dtn_tx {
+  uint8_t type;                   /**< Kind of frame */
+  uint8_t priority;               /**< Priority of the bundle it carries */
+  uint16_t slot;                  /**< Index of the bundle to spray in the
+                                       pool, or of the hand-off to send */
+  rimeaddr_t to;                  /**< Neighbour a request is sent to */
+  rimeaddr_t esender;             /**< Origin of the bundle requested */
+  uint16_t epacketid;             /**< Its sequence number */
+  uint16_t encounter;             /**< Seconds since we heard from its
+                                       destination, 0xffff if never */
+  uint16_t num_copies;            /**< L value of its spray, 0 from a group
+                                       member that has it */
+  uint8_t version;                /**< Header format of its spray */
+  uint8_t flags;                  /**< Flags of the request */
+#if DTN_BATCH > 1
+  clock_time_t queued;            /**< When the request was queued */
+#endif
+};
+
+/**
+ * Counters of a \ref dtn "DTN" connection, since it was opened or since
+ * dtn_reset_stats()
+ */
+struct dtn_stats {
+  unsigned long sprays_sent;      /**< Bundles sprayed */
+  unsigned long adverts_sent;     /**< Spray advertisements sent */
+  unsigned long sprays_recv;      /**< Sprays and advertisements received */
+  unsigned long requests_sent;    /**< Requests sent */
+  unsigned long requests_recv;    /**< Requests received */
+  unsigned long handoffs_sent;    /**< Hand-offs started */
+  unsigned long handoffs_acked;   /**< Hand-offs acknowledged by the
+                                       neighbour */
+  unsigned long handoffs_timedout; /**< Hand-offs given up after #DTN_RTX
+                                        retransmissions */
+  unsigned long handoffs_recv;    /**< Hand-offs received */
+  unsigned long delivered;        /**< Bundles passed to the application */
+  unsigned long duplicates;       /**< Bundles received again here at their
+                                       destination */
+  unsigned long enqueue_failed;   /**< Bundles the store could not take */
+  unsigned long expired;          /**< Bundles dropped as expired */
+  unsigned long evicted;          /**< Bundles dropped by the drop policy */
+  unsigned long tx_dropped;       /**< Frames dropped, transmit queue full */
+  unsigned long congested;        /**< Relay copies not asked for, the
+                                       store being congested, see
+                                       \ref congestion */
+  uint16_t queue_hwm;             /**< Most bundles stored at once */
+};
+
+/**
+ * Radio transmit time of a \ref dtn "DTN" connection per phase, in rtimer
+ * ticks, since it was opened or since dtn_reset_stats(), see \ref energy
+ */
+struct dtn_energy {
+  unsigned long spray;            /**< Sprays, advertisements, summary
+                                       vectors, tombstones and beacons */
+  unsigned long request;          /**< Requests */
+  unsigned long handoff;          /**< Hand-offs, retransmissions
+                                       included */
+};
+
+/**
+ * An event in the trace of a \ref dtn "DTN" connection. The fields are laid
+ * out without padding up to the last one, so that a host can parse records
+ * drained from any node.
+ */
+struct dtn_trace_rec {
+  uint32_t time;                  /**< clock_time() of the event */
+  uint16_t epacketid;             /**< Message's sequence number */
+  uint16_t num_copies;            /**< Number of copies (The L value) */
+  rimeaddr_t esender;             /**< Origin's address */
+  rimeaddr_t peer;                /**< Neighbour involved, null if none */
+  uint8_t event;                  /**< One of the DTN_TRACE_ values */
+  uint8_t gap;                    /**< Records lost just before this one,
+                                       up to 255 */
+};
+
+/** An advertised bundle requested here */
+struct dtn_adv_asked {
+  rimeaddr_t esender;             /**< Origin's address */
+  uint16_t epacketid;             /**< Message's sequence number */
+  clock_time_t when;              /**< When it was requested */
 };
 
+#if DTN_GROUPS
+/** A group bundle passed to the application here */
+struct dtn_group_seen {
+  rimeaddr_t esender;             /**< Origin's address */
+  uint16_t epacketid;             /**< Message's sequence number */
+};
+#endif
+
+#if DTN_FRAG_MAX
+/** A reassembled message passed to the application here */
+struct dtn_reasm_done {
+  rimeaddr_t esender;             /**< Origin's address */
+  uint16_t base;                  /**< Sequence number of the first
+                                       fragment */
+};
+
+/** A fragmented message being reassembled */
+struct dtn_reasm {
+  rimeaddr_t esender;             /**< Origin's address */
+  uint16_t base;                  /**< Sequence number of the first
+                                       fragment */
+  uint8_t count;                  /**< Fragments of the message, 0 if the
+                                       entry is free */
+  uint8_t got;                    /**< Fragments received */
+  uint8_t have[(DTN_FRAG_MAX + 7) / 8]; /**< Bitmap of the fragments
+                                             received */
+  uint16_t len;                   /**< Bytes received */
+  struct timer lifetime;          /**< Given up once expired */
+  uint8_t data[DTN_FRAG_MAX * DTN_FRAG_SIZE]; /**< The message */
+};
+#endif
+
 /** Representation of a \ref dtn "DTN" connections */
 struct dtn_conn {
   struct broadcast_conn spray_c;  /**< The broadcast connection for Spray */
   struct unicast_conn request_c;  /**< The unicast connection for Request */
-  struct runicast_conn handoff_c; /**< The runicast connection for Hand-Off */
   const struct dtn_callbacks *cb; /**< Pointer to the callbacks structure */
-  struct packetqueue *q;          /**< DTN packet queue */
+  struct dtn_store store;         /**< DTN bundle store */
   uint16_t seqno;                 /**< Current sequence number for messages */
+  uint16_t lifetime;              /**< Lifetime of the messages sent, in
+                                       seconds */
   struct ctimer spray_ct;         /**< Timer for Spray */
-  struct dtn_hdr *handoff_qb;     /**< Pointer to queue buffer of the message
-                                       currently being hand-offed */
-  struct dtn_hdr handoff_hdr;     /**< Header of the message currently being
-                                       hand-offed */
+  clock_time_t spray_i;           /**< Current spray interval */
+  clock_time_t spray_rest;        /**< Time left in the interval after the
+                                       spray */
+  uint8_t spray_heard;            /**< Sprays of bundles we hold heard in the
+                                       interval */
+  uint8_t spray_lacked;           /**< A neighbour asked for a bundle of
+                                       ours in the interval */
+  clock_time_t spray_last;        /**< When the last spray round was queued */
+  struct dtn_neighbour nbrs[DTN_NEIGHBOURS]; /**< Neighbours heard recently */
+  struct dtn_handoff handoffs[DTN_HANDOFFS]; /**< Hand-offs in flight */
+  struct dtn_tx txq[DTN_TX_QUEUE]; /**< Transmit queue */
+  uint16_t tx_head;               /**< First frame of the transmit queue */
+  uint16_t tx_len;                /**< Frames in the transmit queue */
+  struct ctimer tx_ct;            /**< Timer for the next transmission */
+  struct dtn_adv_asked adv_asked[DTN_ADV_ASKED]; /**< Ring of the
+                                                     advertised bundles
+                                                     requested lately */
+  uint8_t adv_asked_next;         /**< Oldest entry of the ring */
+#if DTN_SUMMARY_VECTORS
+  struct dtn_sv_neighbour sv_nbr[DTN_SV_NEIGHBOURS]; /**< Neighbours' summary
+                                                          vectors */
+  uint8_t sv_delivered[DTN_SV_BITS / 8]; /**< Bloom filter of the bundles
+                                              delivered here */
+  uint8_t sv_delivered_count;     /**< Bundles added to sv_delivered */
+  clock_time_t sv_sent;           /**< When our summary vector was last sent */
+#endif
+#if DTN_BEACON
+  struct ctimer beacon_ct;        /**< Timer for the next beacon */
+#endif
+#if DTN_TOMBSTONES
+  struct dtn_tombstone tombs[DTN_TOMBSTONES]; /**< Delivered bundles */
+  struct ctimer tomb_ct;          /**< Timer for announcing tombstones */
+#endif
+#if DTN_FRAG_MAX
+  struct dtn_reasm reasm[DTN_REASSEMBLY]; /**< Messages being reassembled */
+  struct dtn_reasm_done reasm_done[DTN_REASM_DONE]; /**< Ring of the
+                                                         messages passed
+                                                         on lately */
+  uint8_t reasm_done_next;        /**< Oldest entry of the ring */
+#endif
+#if DTN_GROUPS
+  uint8_t groups[DTN_GROUPS];     /**< Groups joined */
+  uint8_t groups_len;             /**< Number of groups joined */
+  struct dtn_group_seen group_seen[DTN_GROUP_SEEN]; /**< Ring of the group
+                                                         bundles delivered
+                                                         here */
+  uint8_t group_seen_next;        /**< Oldest entry of the ring */
+#endif
+#if DTN_STATS
+  struct dtn_stats stats;         /**< Counters */
+#endif
+#if DTN_ENERGY
+  struct dtn_energy energy;       /**< Transmit time per phase */
+#endif
+#if DTN_POWER_CONTROL
+  struct ctimer power_ct;         /**< Timer for the next power adjustment */
+  uint8_t power;                  /**< Transmit power level set */
+  uint8_t power_acked;            /**< Hand-offs acked since the last
+                                       adjustment */
+  uint8_t power_timedout;         /**< Hand-offs timed out since the last
+                                       adjustment */
+#endif
+#if DTN_TRACE
+  struct dtn_trace_rec trace[DTN_TRACE]; /**< Ring of recent events */
+  uint16_t trace_head;            /**< Oldest event of the ring */
+  uint16_t trace_len;             /**< Events in the ring */
+#endif
+#if DTN_QUEUE_MAX
+  struct dtn_bundle bundles[DTN_QUEUE_MAX]; /**< Bundles of the pool of
+                                                 dtn_open() */
+  struct dtn_bundle *index[DTN_STORE_INDEX_SIZE]; /**< Its hash buckets */
+#endif
 };
 
 /**
@@ -75,8 +1137,9 @@ struct dtn_conn {
  *     connection to open.
  * \param dtn_channel
  *     Channel number to use for the spray phase in the \ref dtn "DTN"
- *     connection. Note that its following two channels will also be used for
- *     the request and hand-off phases.
+ *     connection. Note that its following 1 + #DTN_HANDOFFS channels will also
+ *     be used for the request and hand-off phases, 2 + #DTN_HANDOFFS in all
+ *     where version 1 used 3, see \ref channels.
  * \param cb
  *     Pointer to a struct \ref dtn_callbacks.
  * \sa dtn_close, dtn_send
@@ -84,11 +1147,34 @@ struct dtn_conn {
 void dtn_open(struct dtn_conn *c, uint16_t dtn_channel,
               const struct dtn_callbacks *cb);
 
+/**
+ * Open a DTN connection with a bundle pool of its own, see \ref pools.
+ * \param c
+ *     Pointer to a struct \ref dtn_conn representing the \ref dtn "DTN"
+ *     connection to open.
+ * \param dtn_channel
+ *     Channel number to use for the spray phase, as with dtn_open().
+ * \param cb
+ *     Pointer to a struct \ref dtn_callbacks.
+ * \param pool
+ *     Pointer to a struct \ref dtn_pool, declared with DTN_POOL(), that no
+ *     other open connection uses.
+ * \note
+ *     With #DTN_CONF_QUEUE_MAX set to 0, struct \ref dtn_conn holds no pool
+ *     and only dtn_open_pool() is available.
+ * \sa dtn_open, dtn_close
+ */
+void dtn_open_pool(struct dtn_conn *c, uint16_t dtn_channel,
+                   const struct dtn_callbacks *cb, struct dtn_pool *pool);
+
 /**
  * Close a DTN connection
  * \param c
  *     Pointer to a struct \ref dtn_conn representing the DTN connection to
  *     close.
+ * \note
+ *     With #DTN_STORE_CFS set the stored bundles stay in the file, and the
+ *     next dtn_open() on the same channel picks them up again.
  * \sa dtn_open, dtn_send
  */
 void dtn_close(struct dtn_conn *c);
@@ -104,14 +1190,226 @@ void dtn_close(struct dtn_conn *c);
  *     Non-Zero if successfully sent
  * \retval
  *     Zero if failed.
- * \sa dtn_open, dtn_close
+ * \note
+ *     When the store is full, a stored bundle is dropped to make room unless
+ *     the drop policy is #DTN_DROP_NONE.
+ * \sa dtn_open, dtn_close, dtn_send_ex, dtn_set_policy, dtn_set_lifetime
  */
 int dtn_send(struct dtn_conn *c, const rimeaddr_t *to);
 
 /**
- * Change the radio power level.
+ * Send the data in the packet buffer over a DTN connection, with its own
+ * number of copies, lifetime and priority, and possibly asking for a
+ * delivery ack.
+ * \param c
+ *     Pointer to a struct \ref dtn_conn representing the DTN connection to
+ *     send over.
+ * \param to
+ *     Pointer to the Rime address of message destination.
+ * \param opts
+ *     Pointer to a struct \ref dtn_send_opts, NULL to send like dtn_send().
+ * \retval
+ *     Non-Zero if successfully sent
+ * \retval
+ *     Zero if failed.
+ * \note
+ *     The ack travels back as a message of its own, so it uses a sequence
+ *     number of the destination and may be lost or late like any other.
+ * \sa dtn_send
+ */
+int dtn_send_ex(struct dtn_conn *c, const rimeaddr_t *to,
+                const struct dtn_send_opts *opts);
+
+/**
+ * Send a message made of pieces over a DTN connection, gathered straight
+ * into the packet buffer, so the application needs no buffer of its own to
+ * put them together in, see \ref copies.
+ * \param c
+ *     Pointer to a struct \ref dtn_conn representing the DTN connection to
+ *     send over.
+ * \param to
+ *     Pointer to the Rime address of message destination.
+ * \param iov
+ *     The pieces of the message, in order.
+ * \param iov_len
+ *     Number of pieces.
+ * \param opts
+ *     Pointer to a struct \ref dtn_send_opts, NULL to send like dtn_send().
+ * \retval
+ *     Non-Zero if successfully sent
+ * \retval
+ *     Zero if failed, also if the pieces do not fit in one packet buffer
+ *     along with the header.
+ * \sa dtn_send_ex, dtn_send_bulk
+ */
+int dtn_send_iov(struct dtn_conn *c, const rimeaddr_t *to,
+                 const struct dtn_iov *iov, uint8_t iov_len,
+                 const struct dtn_send_opts *opts);
+
+/**
+ * Send a message longer than one packet buffer over a DTN connection, in
+ * fragments, see \ref frag.
+ * \param c
+ *     Pointer to a struct \ref dtn_conn representing the DTN connection to
+ *     send over.
+ * \param to
+ *     Pointer to the Rime address of message destination.
+ * \param data
+ *     The message, which is copied, unlike with dtn_send() it does not go
+ *     through the packet buffer.
+ * \param len
+ *     Length of the message, at most #DTN_FRAG_MAX * #DTN_FRAG_SIZE bytes.
+ * \param opts
+ *     Pointer to a struct \ref dtn_send_opts, NULL for the defaults.
+ * \retval
+ *     Non-Zero if successfully sent
+ * \retval
+ *     Zero if failed, also if the store has no free entry for every
+ *     fragment or #DTN_FRAG_MAX is 0.
+ * \note
+ *     The fragments take consecutive sequence numbers, the recv_bulk and
+ *     acked callbacks get the first one.
+ * \sa dtn_send_ex
+ */
+int dtn_send_bulk(struct dtn_conn *c, const rimeaddr_t *to, const void *data,
+                  uint16_t len, const struct dtn_send_opts *opts);
+
+/**
+ * Send the data in the packet buffer to the members of a group, as one
+ * bundle, see \ref groups.
+ * \param c
+ *     Pointer to a struct \ref dtn_conn representing the DTN connection to
+ *     send over.
+ * \param group
+ *     The group, as passed to dtn_join() by its members.
+ * \param members
+ *     Number of members the message is to reach, not counting the sender.
+ * \param opts
+ *     Pointer to a struct \ref dtn_send_opts, NULL for the defaults.
+ * \retval
+ *     Non-Zero if successfully sent
+ * \retval
+ *     Zero if failed, also if #DTN_GROUPS is 0.
+ * \note
+ *     The sender does not get the message itself, even if it is a member.
+ *     A delivery ack is sent by every member.
+ * \sa dtn_send_ex, dtn_join
+ */
+int dtn_send_group(struct dtn_conn *c, uint8_t group, uint8_t members,
+                   const struct dtn_send_opts *opts);
+
+/**
+ * Join a group, so that the messages sent to it are passed to the
+ * application.
+ * \param c
+ *     Pointer to a struct \ref dtn_conn, opened with dtn_open().
+ * \param group
+ *     The group to join.
+ * \retval
+ *     Non-Zero if joined, or a member already
+ * \retval
+ *     Zero if the connection is a member of #DTN_GROUPS groups already.
+ * \sa dtn_leave, dtn_send_group
+ */
+int dtn_join(struct dtn_conn *c, uint8_t group);
+
+/**
+ * Leave a group joined with dtn_join().
+ * \param c
+ *     Pointer to a struct \ref dtn_conn, opened with dtn_open().
+ * \param group
+ *     The group to leave.
+ */
+void dtn_leave(struct dtn_conn *c, uint8_t group);
+
+/**
+ * Make the address of a group, the destination of the messages sent to
+ * it.
+ * \param addr
+ *     Pointer to the Rime address to set.
+ * \param group
+ *     The group.
+ */
+void dtn_group_addr(rimeaddr_t *addr, uint8_t group);
+
+/**
+ * Whether an address is a group's, see dtn_group_addr().
+ */
+int dtn_is_group(const rimeaddr_t *addr);
+
+/**
+ * Set the lifetime of the messages sent next over a DTN connection.
+ * \param c
+ *     Pointer to a struct \ref dtn_conn, opened with dtn_open().
+ * \param lifetime
+ *     Seconds before the messages expire, at most #DTN_MAX_LIFETIME, which
+ *     is also the lifetime dtn_open() sets.
+ * \sa dtn_send
+ */
+void dtn_set_lifetime(struct dtn_conn *c, uint16_t lifetime);
+
+/**
+ * Choose the buffer policies of a DTN connection, see \ref policies.
+ * \param c
+ *     Pointer to a struct \ref dtn_conn, opened with dtn_open().
+ * \param drop
+ *     What to drop when the store is full, one of the DTN_DROP_ values.
+ * \param order
+ *     Which ready bundles to spray first, one of the DTN_ORDER_ values.
+ * \sa dtn_open
+ */
+void dtn_set_policy(struct dtn_conn *c, uint8_t drop, uint8_t order);
+
+/**
+ * Take a snapshot of the counters of a DTN connection.
+ * \param c
+ *     Pointer to a struct \ref dtn_conn representing the DTN connection.
+ * \param stats
+ *     Pointer to a struct \ref dtn_stats to copy the counters to, all zero
+ *     if #DTN_STATS is not set.
+ * \sa dtn_reset_stats
+ */
+void dtn_get_stats(struct dtn_conn *c, struct dtn_stats *stats);
+
+/**
+ * Take a snapshot of the transmit time per phase of a DTN connection.
+ * \param c
+ *     Pointer to a struct \ref dtn_conn representing the DTN connection.
+ * \param energy
+ *     Pointer to a struct \ref dtn_energy to copy it to, all zero if
+ *     #DTN_ENERGY is not set.
+ * \sa dtn_reset_stats
+ */
+void dtn_get_energy(struct dtn_conn *c, struct dtn_energy *energy);
+
+/**
+ * Zero the counters and the transmit times of a DTN connection, the queue
+ * high-water mark restarts from the bundles stored now.
+ * \param c
+ *     Pointer to a struct \ref dtn_conn representing the DTN connection.
+ * \sa dtn_get_stats
+ */
+void dtn_reset_stats(struct dtn_conn *c);
+
+/**
+ * Move the oldest events of the trace of a DTN connection out of its ring.
+ * \param c
+ *     Pointer to a struct \ref dtn_conn representing the DTN connection.
+ * \param recs
+ *     Array to copy the events to, oldest first.
+ * \param max
+ *     Number of events recs can hold.
+ * \return
+ *     Number of events copied, always 0 if #DTN_TRACE is 0.
+ */
+uint16_t dtn_trace_drain(struct dtn_conn *c, struct dtn_trace_rec *recs,
+                         uint16_t max);
+
+/**
+ * Change the radio power level, which the connections change again with
+ * #DTN_POWER_CONTROL set.
  * \param power
- *     The power level.
+ *     The power level, from #DTN_POWER_MIN to #DTN_POWER_MAX.
  */
 void dtn_set_power(uint8_t power);
 
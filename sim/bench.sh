@@ -0,0 +1,41 @@
+#!/bin/sh
+# Scenario benchmark suite for the DTN module.
+#
+# Runs a fixed set of scenarios through the simulator and appends one JSON
+# line per scenario to the results file, so runs of different versions or
+# compile-time settings can be compared. Every trace in traces/*.trace is
+# replayed as an extra scenario.
+#
+# usage: bench.sh [simulator] [results-file]
+
+SIM=${1:-./dtn-sim}
+OUT=${2:-bench-results.jsonl}
+DIR=$(dirname "$0")
+SEED=${BENCH_SEED:-1}
+
+run() {
+  name=$1
+  shift
+  echo "== $name"
+  "$SIM" -N "$name" -j "$OUT" -s "$SEED" "$@" | \
+    grep -E '^(delivered|latency|broadcast|unicast|runicast frames)'
+}
+
+run mesh-20       -n 20  -t 600  -m 100
+run mesh-20-lossy -n 20  -t 600  -m 100 -l 0.3
+run rwp-50        -n 50  -t 3600 -m 200 -M rwp -a 1000x1000 -r 100
+run rwp-200       -n 200 -t 3600 -m 500 -M rwp -a 2000x2000 -r 100 -l 0.1
+run grid-100      -n 100 -t 1800 -m 200 -M grid -r 100
+run rwp-50-80b    -n 50  -t 3600 -m 200 -M rwp -a 1000x1000 -r 100 -S 80
+run grid-100-80b  -n 100 -t 1800 -m 200 -M grid -r 100 -S 80
+
+for trace in "$DIR"/traces/*.trace; do
+  [ -e "$trace" ] || continue
+  nodes=$(awk '$2 == "CONN" { if($3 > m) m = $3; if($4 > m) m = $4 }
+               END { print m + 1 }' "$trace")
+  end=$(awk '$2 == "CONN" { t = $1 } END { printf "%d", t + 1 }' "$trace")
+  run "trace-$(basename "$trace" .trace)" -n "$nodes" -t "$end" -m 200 \
+      -T "$trace"
+done
+
+echo "results appended to $OUT"
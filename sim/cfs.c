@@ -0,0 +1,118 @@
+/**
+ * \file
+ *     Simulated CFS. Every node has its own flash: its files are host files
+ *     named "<node id>.<name>" in the flash directory, which is a fresh
+ *     temporary directory unless one is given with sim_cfs_dir(). Files
+ *     outlive dtn_close(), so a node reopening its connection finds them.
+ */
+#include "sim.h"
+#include "cfs/cfs.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static char dir[PATH_MAX];
+static int temporary;
+/*---------------------------------------------------------------------------*/
+void
+sim_cfs_dir(const char *path)
+{
+  snprintf(dir, sizeof(dir), "%s", path);
+  temporary = 0;
+}
+/*---------------------------------------------------------------------------*/
+static int
+path_of(char *path, size_t size, const char *name)
+{
+  if(dir[0] == '\0') {
+    snprintf(dir, sizeof(dir), "/tmp/dtn-sim-cfs-XXXXXX");
+    if(mkdtemp(dir) == NULL) {
+      dir[0] = '\0';
+      return -1;
+    }
+    temporary = 1;
+  }
+  snprintf(path, size, "%s/%d.%s", dir, sim_current->id, name);
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+int
+cfs_open(const char *name, int flags)
+{
+  char path[PATH_MAX];
+  int oflags;
+  if(path_of(path, sizeof(path), name) < 0) {
+    return -1;
+  }
+  if((flags & (CFS_READ | CFS_WRITE)) == (CFS_READ | CFS_WRITE)) {
+    oflags = O_RDWR | O_CREAT;
+  } else if(flags & CFS_WRITE) {
+    oflags = O_WRONLY | O_CREAT;
+  } else {
+    oflags = O_RDONLY;
+  }
+  if(flags & CFS_APPEND) {
+    oflags |= O_APPEND | O_CREAT;
+  }
+  return open(path, oflags, 0644);
+}
+/*---------------------------------------------------------------------------*/
+void
+cfs_close(int fd)
+{
+  close(fd);
+}
+/*---------------------------------------------------------------------------*/
+int
+cfs_read(int fd, void *buf, unsigned int len)
+{
+  return read(fd, buf, len);
+}
+/*---------------------------------------------------------------------------*/
+int
+cfs_write(int fd, const void *buf, unsigned int len)
+{
+  return write(fd, buf, len);
+}
+/*---------------------------------------------------------------------------*/
+cfs_offset_t
+cfs_seek(int fd, cfs_offset_t offset, int whence)
+{
+  return lseek(fd, offset, whence == CFS_SEEK_SET ? SEEK_SET
+                           : whence == CFS_SEEK_CUR ? SEEK_CUR : SEEK_END);
+}
+/*---------------------------------------------------------------------------*/
+int
+cfs_remove(const char *name)
+{
+  char path[PATH_MAX];
+  if(path_of(path, sizeof(path), name) < 0) {
+    return -1;
+  }
+  return unlink(path);
+}
+/*---------------------------------------------------------------------------*/
+void
+sim_cfs_reset(void)
+{
+  char path[PATH_MAX + 256];
+  struct dirent *e;
+  DIR *d;
+  if(temporary && (d = opendir(dir)) != NULL) {
+    while((e = readdir(d)) != NULL) {
+      if(e->d_name[0] != '.') {
+        snprintf(path, sizeof(path), "%s/%s", dir, e->d_name);
+        unlink(path);
+      }
+    }
+    closedir(d);
+    rmdir(dir);
+  }
+  dir[0] = '\0';
+  temporary = 0;
+}
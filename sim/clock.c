@@ -0,0 +1,179 @@
+/**
+ * \file
+ *     Simulated clock, random generator, passive and callback timers
+ */
+#include "sim.h"
+
+#include <stdlib.h>
+
+#define TICKS_TO_US(t) ((uint64_t)(t) * SIM_USEC_PER_SEC / CLOCK_SECOND)
+#define US_TO_TICKS(us) ((clock_time_t)((us) * CLOCK_SECOND / SIM_USEC_PER_SEC))
+
+struct ctimer_ticket {
+  struct ctimer *c;
+};
+/*-CLOCK---------------------------------------------------------------------*/
+clock_time_t
+clock_time(void)
+{
+  return US_TO_TICKS(sim_local_time());
+}
+/*---------------------------------------------------------------------------*/
+unsigned long
+clock_seconds(void)
+{
+  return (unsigned long)(sim_local_time() / SIM_USEC_PER_SEC);
+}
+/*---------------------------------------------------------------------------*/
+void
+clock_delay_usec(uint16_t dt)
+{
+  if(sim_current == NULL) {
+    return;
+  }
+  sim_current->busy_until = sim_local_time() + dt;
+}
+/*---------------------------------------------------------------------------*/
+void
+clock_delay_msec(uint16_t dt)
+{
+  while(dt--) {
+    clock_delay_usec(1000);
+  }
+}
+/*-TIMER---------------------------------------------------------------------*/
+void
+timer_set(struct timer *t, clock_time_t interval)
+{
+  t->interval = interval;
+  t->start = clock_time();
+}
+/*---------------------------------------------------------------------------*/
+void
+timer_reset(struct timer *t)
+{
+  t->start += t->interval;
+}
+/*---------------------------------------------------------------------------*/
+void
+timer_restart(struct timer *t)
+{
+  t->start = clock_time();
+}
+/*---------------------------------------------------------------------------*/
+int
+timer_expired(struct timer *t)
+{
+  clock_time_t diff = (clock_time() - t->start) + 1;
+  return t->interval < diff;
+}
+/*---------------------------------------------------------------------------*/
+clock_time_t
+timer_remaining(struct timer *t)
+{
+  return t->start + t->interval - clock_time();
+}
+/*-RANDOM--------------------------------------------------------------------*/
+void
+random_init(unsigned short seed)
+{
+  /* All simulated nodes boot at the same instant, keep their streams apart */
+  if(sim_current != NULL) {
+    sim_current->rand_state ^= (uint32_t)seed << 16 | seed;
+    if(sim_current->rand_state == 0) {
+      sim_current->rand_state = sim_current->id + 1;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+unsigned short
+random_rand(void)
+{
+  uint32_t *s;
+  if(sim_current == NULL) {
+    return sim_rand() >> 16;
+  }
+  s = &sim_current->rand_state;
+  *s ^= *s << 13;
+  *s ^= *s >> 17;
+  *s ^= *s << 5;
+  return *s >> 16;
+}
+/*-CTIMER--------------------------------------------------------------------*/
+static void
+ctimer_fire(void *arg)
+{
+  struct ctimer_ticket *t = arg;
+  struct ctimer *c = t->c;
+  free(t);
+  if(c == NULL) {
+    return; /* stopped */
+  }
+  c->ticket = NULL;
+  c->active = 0;
+  if(c->f != NULL) {
+    c->f(c->ptr);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+ctimer_cancel(struct ctimer *c)
+{
+  if(c->ticket != NULL) {
+    ((struct ctimer_ticket *)c->ticket)->c = NULL;
+    c->ticket = NULL;
+  }
+  c->active = 0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+ctimer_arm(struct ctimer *c)
+{
+  struct ctimer_ticket *t = malloc(sizeof(struct ctimer_ticket));
+  t->c = c;
+  c->ticket = t;
+  c->active = 1;
+  c->node = sim_current != NULL ? sim_current->id : -1;
+  sim_schedule(TICKS_TO_US(c->start + c->interval), c->node,
+               c->node < 0 ? SIM_EV_GLOBAL : SIM_EV_CPU, ctimer_fire, t);
+}
+/*---------------------------------------------------------------------------*/
+void
+ctimer_set(struct ctimer *c, clock_time_t t, void (*f)(void *), void *ptr)
+{
+  ctimer_cancel(c);
+  c->f = f;
+  c->ptr = ptr;
+  c->start = clock_time();
+  c->interval = t;
+  ctimer_arm(c);
+}
+/*---------------------------------------------------------------------------*/
+void
+ctimer_reset(struct ctimer *c)
+{
+  ctimer_cancel(c);
+  c->start += c->interval;
+  ctimer_arm(c);
+}
+/*---------------------------------------------------------------------------*/
+void
+ctimer_restart(struct ctimer *c)
+{
+  ctimer_cancel(c);
+  c->start = clock_time();
+  ctimer_arm(c);
+}
+/*---------------------------------------------------------------------------*/
+void
+ctimer_stop(struct ctimer *c)
+{
+  ctimer_cancel(c);
+}
+/*---------------------------------------------------------------------------*/
+int
+ctimer_expired(struct ctimer *c)
+{
+  return !c->active;
+}
+/*---------------------------------------------------------------------------*/
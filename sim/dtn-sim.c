@@ -0,0 +1,878 @@
+/**
+ * \file
+ *     Host-native multi-node simulator for the \ref dtn module
+ *
+ *     Every virtual node opens one DTN connection. Bundles are injected
+ *     between random pairs of nodes while links follow a mobility model,
+ *     a contact plan or a connectivity trace. The run ends with a summary
+ *     of deliveries, latency and radio activity, optionally also written
+ *     as one JSON object per run for the benchmark suite.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "sim.h"
+#include "mobility.h"
+#include "dtn.h"
+#include "dtn-v1.h"
+#include "sys/rtimer.h"
+
+#define DTN_CHANNEL 128
+
+struct bundle {
+  int src;
+  int dst;
+  uint64_t created;
+  uint64_t delivered;
+  uint64_t acked;
+  unsigned dups;
+  uint8_t accepted;
+  uint8_t alarm;
+};
+
+struct app {
+  struct dtn_conn conn;
+  int *bundles;          /**< Bundle index by DTN sequence number */
+  int num_bundles;
+  FILE *events;          /**< Drained trace of the connection, or NULL */
+  struct dtn_pool pool;  /**< Bundle pool of the connection with -Q */
+  struct dtn_v1 *v1;     /**< Version 1 connection of a -L node, else NULL */
+};
+
+/* Header of an event file, followed by struct dtn_trace_rec in host order */
+struct events_hdr {
+  char magic[4];         /**< "DTNT" */
+  uint8_t version;
+  uint8_t addr_size;     /**< RIMEADDR_SIZE */
+  uint8_t rec_size;      /**< sizeof(struct dtn_trace_rec) */
+  uint8_t pad;
+  uint16_t clock_second; /**< CLOCK_SECOND, the unit of the records' time */
+  rimeaddr_t addr;       /**< The node's address */
+};
+
+static struct bundle *bundles;
+static int num_bundles;
+static struct app *apps;
+static unsigned long misdelivered, unknown, corrupted;
+static int verbose;
+static int bulk;
+static int msg_size;
+static int sinks;
+static int pool_size;
+static int v1_nodes;
+static int power = -1;
+static double alarms;
+static int drop_policy = DTN_DROP_POLICY, spray_order = DTN_SPRAY_ORDER;
+
+#define EVENTS_VERSION 1
+#define EVENTS_INTERVAL SIM_USEC_PER_SEC
+
+static const char *drop_names[] = {"none", "oldest", "copies", "expiry", NULL};
+static const char *order_names[] = {"fifo", "copies", "expiry", NULL};
+/*---------------------------------------------------------------------------*/
+static struct bundle *
+bundle_lookup(int src, uint16_t seqno)
+{
+  struct app *a = &apps[src];
+  if(seqno >= a->num_bundles || a->bundles[seqno] < 0) {
+    return NULL;
+  }
+  return &bundles[a->bundles[seqno]];
+}
+/*---------------------------------------------------------------------------*/
+static void
+recv(struct dtn_conn *c, const rimeaddr_t *from, uint16_t packetid)
+{
+  struct sim_node *src = sim_node_by_addr(from);
+  struct bundle *b = src != NULL ? bundle_lookup(src->id, packetid) : NULL;
+  if(b == NULL) {
+    unknown++;
+    return;
+  }
+  if(sinks > 0 && DTN_GROUPS) { // one bundle, the first record of a reading
+    b += sim_current->id < sinks ? sim_current->id : 0;
+  }
+  if(b->dst != sim_current->id) {
+    misdelivered++;
+    return;
+  }
+  if(b->delivered) {
+    b->dups++;
+    return;
+  }
+  b->delivered = sim_local_time();
+  if(verbose) {
+    printf("%.3f: delivered %d -> %d #%u after %.3f s\n",
+           sim_local_time() / 1e6, b->src, b->dst, packetid,
+           (b->delivered - b->created) / 1e6);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+acked(struct dtn_conn *c, const rimeaddr_t *to, uint16_t packetid)
+{
+  struct bundle *b = bundle_lookup(sim_current->id, packetid);
+  struct sim_node *dst = sim_node_by_addr(to);
+  if(b != NULL && sinks > 0 && DTN_GROUPS && dst != NULL && dst->id < sinks) {
+    b += dst->id;
+  }
+  if(b == NULL || b->acked) {
+    return;
+  }
+  b->acked = sim_local_time();
+  if(verbose) {
+    printf("%.3f: acked %d -> %d #%u after %.3f s\n",
+           sim_local_time() / 1e6, b->src, b->dst, packetid,
+           (b->acked - b->created) / 1e6);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static uint8_t
+bulk_byte(int src, uint16_t seqno, int i)
+{
+  return (uint8_t)(src * 31 + seqno + i);
+}
+/*---------------------------------------------------------------------------*/
+/* "sim-<src>-<seqno>", padded to msg_size bytes, return its length. */
+static int
+sim_message(uint8_t *buf, int src, uint16_t seqno)
+{
+  int i, len = snprintf((char *)buf, 32, "sim-%d-%u", src, seqno) + 1;
+  for(i = len; i < msg_size; i++) {
+    buf[i] = bulk_byte(src, seqno, i);
+  }
+  return i;
+}
+/*---------------------------------------------------------------------------*/
+static void
+recv_bulk(struct dtn_conn *c, const rimeaddr_t *from, uint16_t packetid,
+          const uint8_t *data, uint16_t len)
+{
+  struct sim_node *src = sim_node_by_addr(from);
+  int i;
+  if(src != NULL) {
+    for(i = 0; i < len; i++) {
+      if(data[i] != bulk_byte(src->id, packetid, i)) {
+        break;
+      }
+    }
+    if(len != bulk || i < len) {
+      corrupted++;
+      return;
+    }
+  }
+  recv(c, from, packetid);
+}
+/*---------------------------------------------------------------------------*/
+/* The message of a bundle, from sim_message(), where it lies. */
+static void
+recv_data(struct dtn_conn *c, const rimeaddr_t *from, uint16_t packetid,
+          const uint8_t *data, uint16_t len)
+{
+  struct sim_node *src = sim_node_by_addr(from);
+  uint8_t msg[PACKETBUF_SIZE];
+  if(src != NULL) {
+    if(len != sim_message(msg, src->id, packetid)
+       || memcmp(data, msg, len) != 0) {
+      corrupted++;
+      return;
+    }
+  }
+  recv(c, from, packetid);
+}
+/*---------------------------------------------------------------------------*/
+static void
+recv_v1(const rimeaddr_t *from, uint16_t packetid, const uint8_t *data,
+        uint16_t len)
+{
+  recv_data(NULL, from, packetid, data, len);
+}
+/*---------------------------------------------------------------------------*/
+static const struct dtn_callbacks callbacks = {recv, acked, recv_bulk,
+                                               recv_data};
+/*---------------------------------------------------------------------------*/
+static int
+parse_name(const char **names, const char *name)
+{
+  int i;
+  for(i = 0; names[i] != NULL; i++) {
+    if(strcmp(names[i], name) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+/*---------------------------------------------------------------------------*/
+static void
+node_boot(void *arg)
+{
+  struct app *a = arg;
+  if(a->v1 != NULL) {
+    dtn_v1_open(a->v1, DTN_CHANNEL, recv_v1);
+    return;
+  }
+  if(pool_size > 0) {
+    dtn_open_pool(&a->conn, DTN_CHANNEL, &callbacks, &a->pool);
+  } else {
+#if DTN_QUEUE_MAX
+    dtn_open(&a->conn, DTN_CHANNEL, &callbacks);
+#endif
+  }
+  dtn_set_policy(&a->conn, drop_policy, spray_order);
+  if(a - apps < sinks) {
+    dtn_join(&a->conn, 0);
+  }
+  if(power >= 0) {
+    dtn_set_power(power);
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* What DTN_POOL() declares, allocated for one simulated node. */
+static void
+pool_alloc(struct dtn_pool *p, int size)
+{
+  p->size = size;
+  p->bundles = calloc(size, sizeof(struct dtn_bundle));
+  p->index_size = size;
+  p->index = calloc(size, sizeof(struct dtn_bundle *));
+  p->file = DTN_STORE_FILE;
+}
+/*---------------------------------------------------------------------------*/
+static void
+pool_free(struct dtn_pool *p)
+{
+  free(p->bundles);
+  free(p->index);
+}
+/*---------------------------------------------------------------------------*/
+static void
+events_drain(struct app *a)
+{
+  struct dtn_trace_rec recs[16];
+  uint16_t n;
+  while((n = dtn_trace_drain(&a->conn, recs, 16)) > 0) {
+    fwrite(recs, sizeof(struct dtn_trace_rec), n, a->events);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+events_timer(void *arg)
+{
+  struct app *a = arg;
+  events_drain(a);
+  sim_schedule(sim_now + EVENTS_INTERVAL, sim_current->id, SIM_EV_CPU,
+               events_timer, a);
+}
+/*---------------------------------------------------------------------------*/
+static int
+events_open(const char *dir, int id)
+{
+  struct events_hdr h;
+  char path[1024];
+  struct app *a = &apps[id];
+
+  snprintf(path, sizeof(path), "%s/%d.events", dir, id);
+  if((a->events = fopen(path, "wb")) == NULL) {
+    perror(path);
+    return -1;
+  }
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, "DTNT", 4);
+  h.version = EVENTS_VERSION;
+  h.addr_size = RIMEADDR_SIZE;
+  h.rec_size = sizeof(struct dtn_trace_rec);
+  h.clock_second = CLOCK_SECOND;
+  rimeaddr_copy(&h.addr, &sim_nodes[id].addr);
+  fwrite(&h, sizeof(h), 1, a->events);
+  sim_schedule(EVENTS_INTERVAL, id, SIM_EV_CPU, events_timer, a);
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+node_reboot(void *arg)
+{
+  struct app *a = arg;
+  if(a->events != NULL) {
+    events_drain(a);
+  }
+  if(a->v1 != NULL) {
+    dtn_v1_close(a->v1);
+  } else {
+    dtn_close(&a->conn);
+  }
+  node_boot(a);
+}
+/*---------------------------------------------------------------------------*/
+static void
+bundle_map(struct app *a, uint16_t seqno, int i)
+{
+  if(seqno >= a->num_bundles) {
+    int n = seqno + 64;
+    a->bundles = realloc(a->bundles, n * sizeof(int));
+    while(a->num_bundles < n) {
+      a->bundles[a->num_bundles++] = -1;
+    }
+  }
+  a->bundles[seqno] = i;
+}
+/*---------------------------------------------------------------------------*/
+static void
+send_bundle(void *arg)
+{
+  struct bundle *b = &bundles[(intptr_t)arg];
+  struct app *a = &apps[b->src];
+  uint16_t seqno = a->v1 != NULL ? dtn_v1_seqno(a->v1) : a->conn.seqno;
+  struct dtn_send_opts opts = {2 * DTN_L_COPIES, 0,
+                               DTN_PRIORITY_EXPEDITED, 1};
+  struct dtn_iov iov;
+  uint8_t msg[PACKETBUF_SIZE];
+  int len;
+
+  bundle_map(a, seqno, (int)(intptr_t)arg);
+
+  b->created = sim_local_time();
+  if(bulk > 0) {
+    uint8_t *data = malloc(bulk);
+    for(len = 0; len < bulk; len++) {
+      data[len] = bulk_byte(b->src, seqno, len);
+    }
+    b->accepted = dtn_send_bulk(&a->conn, &sim_nodes[b->dst].addr, data, bulk,
+                                b->alarm ? &opts : NULL) != 0;
+    free(data);
+    return;
+  }
+  if(a->v1 != NULL) { // plain messages only
+    packetbuf_copyfrom(msg, sim_message(msg, b->src, seqno));
+    b->accepted = dtn_v1_send(a->v1, &sim_nodes[b->dst].addr) != 0;
+    return;
+  }
+  iov.data = msg;
+  iov.len = sim_message(msg, b->src, seqno);
+  b->accepted = dtn_send_iov(&a->conn, &sim_nodes[b->dst].addr, &iov, 1,
+                             b->alarm ? &opts : NULL) != 0;
+}
+/*---------------------------------------------------------------------------*/
+/* One reading for every sink, a group bundle if the build has groups. */
+static void
+send_reading(void *arg)
+{
+  int first = (int)(intptr_t)arg, i, len;
+  struct bundle *b = &bundles[first];
+  struct app *a = &apps[b->src];
+  struct dtn_send_opts opts = {2 * DTN_L_COPIES, 0,
+                               DTN_PRIORITY_EXPEDITED, 1};
+  uint8_t msg[PACKETBUF_SIZE];
+  uint8_t accepted;
+
+  if(!DTN_GROUPS) {
+    for(i = 0; i < sinks; i++) {
+      send_bundle((void *)(intptr_t)(first + i));
+    }
+    return;
+  }
+  bundle_map(a, a->conn.seqno, first);
+  len = sim_message(msg, b->src, a->conn.seqno);
+  packetbuf_copyfrom(msg, len);
+  accepted = dtn_send_group(&a->conn, 0, sinks,
+                            b->alarm ? &opts : NULL) != 0;
+  for(i = 0; i < sinks; i++) {
+    b[i].created = sim_local_time();
+    b[i].accepted = accepted;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static int
+cmp_u64(const void *a, const void *b)
+{
+  uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+  return x < y ? -1 : x > y;
+}
+/*---------------------------------------------------------------------------*/
+static double
+percentile(const uint64_t *sorted, int n, double p)
+{
+  int i;
+  if(n == 0) {
+    return 0;
+  }
+  i = (int)(p * n + 0.999999) - 1;
+  if(i < 0) {
+    i = 0;
+  }
+  return sorted[i] / 1e6;
+}
+/*---------------------------------------------------------------------------*/
+static double
+per(unsigned long frames, int delivered)
+{
+  return delivered ? (double)frames / delivered : 0;
+}
+/*---------------------------------------------------------------------------*/
+struct results {
+  struct sim_radio_stats radio;
+  struct dtn_stats dtn;
+  struct dtn_energy energy;
+  double power;               /**< Mean transmit power level at the end */
+  int accepted;
+  int delivered;
+  unsigned long dups;
+  double mean, median, p99, max;
+  int alarms, alarms_delivered, alarms_acked;
+  double alarms_median;
+};
+/*---------------------------------------------------------------------------*/
+static void
+collect(struct results *r)
+{
+  uint64_t *lat;
+  double sum = 0;
+  int i;
+
+  memset(r, 0, sizeof(*r));
+  for(i = 0; i < sim_num_nodes; i++) {
+    struct sim_radio_stats *s = &sim_nodes[i].stats;
+    r->radio.broadcast_tx += s->broadcast_tx;
+    r->radio.unicast_tx += s->unicast_tx;
+    r->radio.runicast_tx += s->runicast_tx;
+    r->radio.runicast_ack_tx += s->runicast_ack_tx;
+    r->radio.runicast_sent += s->runicast_sent;
+    r->radio.runicast_timedout += s->runicast_timedout;
+    r->radio.rx += s->rx;
+    r->radio.rx_lost += s->rx_lost;
+    r->radio.rx_overflow += s->rx_overflow;
+    r->radio.tx_bytes += s->tx_bytes;
+    r->radio.tx_us += s->tx_us;
+    r->radio.tx_nj += s->tx_nj;
+    r->power += (double)sim_nodes[i].tx_power / sim_num_nodes;
+    r->radio.busy_us += s->busy_us;
+  }
+  for(i = 0; i < sim_num_nodes; i++) {
+    struct dtn_stats s;
+    struct dtn_energy e;
+    dtn_get_energy(&apps[i].conn, &e);
+    r->energy.spray += e.spray;
+    r->energy.request += e.request;
+    r->energy.handoff += e.handoff;
+    dtn_get_stats(&apps[i].conn, &s);
+    r->dtn.handoffs_acked += s.handoffs_acked;
+    r->dtn.handoffs_timedout += s.handoffs_timedout;
+    r->dtn.enqueue_failed += s.enqueue_failed;
+    r->dtn.expired += s.expired;
+    r->dtn.evicted += s.evicted;
+    r->dtn.tx_dropped += s.tx_dropped;
+    r->dtn.congested += s.congested;
+    if(s.queue_hwm > r->dtn.queue_hwm) {
+      r->dtn.queue_hwm = s.queue_hwm;
+    }
+  }
+
+  lat = malloc((num_bundles + 1) * sizeof(uint64_t));
+  for(i = 0; i < num_bundles; i++) {
+    if(bundles[i].alarm) {
+      r->alarms++;
+      r->alarms_acked += bundles[i].acked != 0;
+      if(bundles[i].delivered) {
+        lat[r->alarms_delivered++] = bundles[i].delivered - bundles[i].created;
+      }
+    }
+  }
+  qsort(lat, r->alarms_delivered, sizeof(uint64_t), cmp_u64);
+  r->alarms_median = percentile(lat, r->alarms_delivered, 0.5);
+
+  for(i = 0; i < num_bundles; i++) {
+    r->accepted += bundles[i].accepted;
+    r->dups += bundles[i].dups;
+    if(bundles[i].delivered) {
+      lat[r->delivered++] = bundles[i].delivered - bundles[i].created;
+      sum += bundles[i].delivered - bundles[i].created;
+    }
+  }
+  qsort(lat, r->delivered, sizeof(uint64_t), cmp_u64);
+  if(r->delivered) {
+    r->mean = sum / r->delivered / 1e6;
+    r->median = percentile(lat, r->delivered, 0.5);
+    r->p99 = percentile(lat, r->delivered, 0.99);
+    r->max = lat[r->delivered - 1] / 1e6;
+  }
+  free(lat);
+}
+/*---------------------------------------------------------------------------*/
+static void
+report(const struct results *r, int nodes, double duration)
+{
+  printf("nodes                %d\n", nodes);
+  printf("duration             %.0f s\n", duration);
+  printf("bundles              %d (%d accepted)\n", num_bundles, r->accepted);
+  printf("delivered            %d (%.1f%%)\n", r->delivered,
+         num_bundles ? 100.0 * r->delivered / num_bundles : 0.0);
+  printf("duplicates           %lu\n", r->dups);
+  if(r->alarms) {
+    printf("alarms               %d (%d delivered, %d acked, median %.3f s)\n",
+           r->alarms, r->alarms_delivered, r->alarms_acked, r->alarms_median);
+  }
+  if(r->delivered) {
+    printf("latency mean/median  %.3f / %.3f s\n", r->mean, r->median);
+    printf("latency p99/max      %.3f / %.3f s\n", r->p99, r->max);
+  }
+  printf("broadcast frames     %lu (%.2f per delivered)\n",
+         r->radio.broadcast_tx, per(r->radio.broadcast_tx, r->delivered));
+  printf("unicast frames       %lu (%.2f per delivered)\n",
+         r->radio.unicast_tx, per(r->radio.unicast_tx, r->delivered));
+  printf("runicast frames      %lu (%.2f per delivered, +%lu acks)\n",
+         r->radio.runicast_tx, per(r->radio.runicast_tx, r->delivered),
+         r->radio.runicast_ack_tx);
+  printf("runicast sent/tmo    %lu / %lu\n",
+         r->radio.runicast_sent, r->radio.runicast_timedout);
+  printf("bytes on air         %llu\n", r->radio.tx_bytes);
+  printf("tx energy            %.1f mJ (%.3f per delivered, %.3f s on air)\n",
+         r->radio.tx_nj / 1e6,
+         r->delivered ? r->radio.tx_nj / 1e6 / r->delivered : 0.0,
+         r->radio.tx_us / 1e6);
+  if(DTN_ENERGY) {
+    printf("tx spray/req/hand-off %.3f / %.3f / %.3f s\n",
+           (double)r->energy.spray / RTIMER_SECOND,
+           (double)r->energy.request / RTIMER_SECOND,
+           (double)r->energy.handoff / RTIMER_SECOND);
+  }
+  printf("tx power mean        %.1f of %d\n", r->power, SIM_POWER_MAX);
+  printf("frames received      %lu (%lu lost, %lu overflowed)\n",
+         r->radio.rx, r->radio.rx_lost, r->radio.rx_overflow);
+  printf("cpu busy-wait        %.3f s\n", r->radio.busy_us / 1e6);
+  printf("hand-offs acked/tmo  %lu / %lu\n",
+         r->dtn.handoffs_acked, r->dtn.handoffs_timedout);
+  if(r->dtn.congested) {
+    printf("congestion refusals  %lu\n", r->dtn.congested);
+  }
+  printf("store drops          %lu expired, %lu evicted, %lu refused\n",
+         r->dtn.expired, r->dtn.evicted, r->dtn.enqueue_failed);
+  printf("store high-water     %u of %d\n", r->dtn.queue_hwm,
+         pool_size > 0 ? pool_size : DTN_QUEUE_MAX);
+  if(r->dtn.tx_dropped) {
+    printf("tx queue drops       %lu\n", r->dtn.tx_dropped);
+  }
+  if(misdelivered || unknown) {
+    printf("misdelivered         %lu (+%lu unknown)\n", misdelivered, unknown);
+  }
+  if(corrupted) {
+    printf("corrupted            %lu\n", corrupted);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+report_json(FILE *f, const struct results *r, const char *name,
+            int nodes, double duration, uint32_t seed)
+{
+  fprintf(f, "{\"scenario\": \"%s\", \"nodes\": %d, \"duration\": %.0f, "
+          "\"seed\": %u, ", name, nodes, duration, seed);
+  fprintf(f, "\"params\": {\"l_copies\": %d, \"queue_max\": %d, "
+          "\"max_lifetime\": %d, \"spray_delay\": %d, \"rtx\": %d}, ",
+          DTN_L_COPIES, pool_size > 0 ? pool_size : DTN_QUEUE_MAX,
+          DTN_MAX_LIFETIME, DTN_SPRAY_DELAY,
+          DTN_RTX);
+  fprintf(f, "\"bundles\": %d, \"accepted\": %d, \"delivered\": %d, "
+          "\"delivery_ratio\": %.4f, \"duplicates\": %lu, ",
+          num_bundles, r->accepted, r->delivered,
+          num_bundles ? (double)r->delivered / num_bundles : 0.0, r->dups);
+  fprintf(f, "\"alarms\": {\"sent\": %d, \"delivered\": %d, \"acked\": %d, "
+          "\"median\": %.3f}, ", r->alarms, r->alarms_delivered,
+          r->alarms_acked, r->alarms_median);
+  fprintf(f, "\"latency\": {\"mean\": %.3f, \"median\": %.3f, "
+          "\"p99\": %.3f, \"max\": %.3f}, ",
+          r->mean, r->median, r->p99, r->max);
+  fprintf(f, "\"frames\": {\"broadcast\": %lu, \"unicast\": %lu, "
+          "\"runicast\": %lu, \"runicast_ack\": %lu, "
+          "\"runicast_timedout\": %lu}, ",
+          r->radio.broadcast_tx, r->radio.unicast_tx, r->radio.runicast_tx,
+          r->radio.runicast_ack_tx, r->radio.runicast_timedout);
+  fprintf(f, "\"per_delivered\": {\"broadcast\": %.3f, \"unicast\": %.3f, "
+          "\"runicast\": %.3f}, ",
+          per(r->radio.broadcast_tx, r->delivered),
+          per(r->radio.unicast_tx, r->delivered),
+          per(r->radio.runicast_tx, r->delivered));
+  fprintf(f, "\"store\": {\"expired\": %lu, \"evicted\": %lu, "
+          "\"refused\": %lu, \"high_water\": %u}, \"tx_dropped\": %lu, ",
+          r->dtn.expired, r->dtn.evicted, r->dtn.enqueue_failed,
+          r->dtn.queue_hwm, r->dtn.tx_dropped);
+  fprintf(f, "\"congested\": %lu, ", r->dtn.congested);
+  fprintf(f, "\"tx_energy_mj\": %.3f, \"tx_power\": %.2f, ",
+          r->radio.tx_nj / 1e6, r->power);
+  fprintf(f, "\"bytes_on_air\": %llu, \"rx_lost\": %lu, "
+          "\"rx_overflow\": %lu, \"busy_wait\": %.3f}\n",
+          r->radio.tx_bytes, r->radio.rx_lost, r->radio.rx_overflow,
+          r->radio.busy_us / 1e6);
+}
+/*---------------------------------------------------------------------------*/
+static void
+usage(const char *prog)
+{
+  fprintf(stderr,
+          "usage: %s [-n nodes] [-t seconds] [-m bundles] [-w seconds]\n"
+          "          [-l loss] [-M model] [-a WxH] [-r range] [-V min:max]\n"
+          "          [-p pause] [-c contact-plan] [-T trace] [-W trace]\n"
+          "          [-R seconds] [-F dir] [-D policy] [-O order]\n"
+          "          [-A fraction] [-B bytes] [-S bytes] [-Q bundles]\n"
+          "          [-P level] [-G sinks] [-X dir] [-L nodes] [-N name]\n"
+          "          [-j file] [-s seed] [-v]\n"
+          "\n"
+          "  -n  number of nodes (default 20)\n"
+          "  -t  simulated time in seconds (default 600)\n"
+          "  -m  number of bundles to inject (default 100)\n"
+          "  -w  bundles are injected during the first w seconds\n"
+          "      (default half the simulated time)\n"
+          "  -l  frame loss probability on every link (default 0)\n"
+          "  -M  mobility model: mesh (default), rwp or grid\n"
+          "  -a  area for rwp in metres (default 1000x1000)\n"
+          "  -r  radio range in metres (default 100)\n"
+          "  -V  rwp speed range in m/s (default 0.5:1.5)\n"
+          "  -p  rwp maximum pause at a waypoint in seconds (default 60)\n"
+          "  -c  contact plan, lines of \"start end a b [loss]\"\n"
+          "  -T  connectivity trace, lines of \"time CONN a b up|down\"\n"
+          "  -W  record the link changes of this run as a trace\n"
+          "  -R  close and reopen every node's connection at this time, only\n"
+          "      bundles kept by DTN_CONF_STORE_CFS=1 survive\n"
+          "  -F  directory for the nodes' CFS files (default a temporary one)\n"
+          "  -D  drop policy of a full store: none, oldest, copies (highest L)\n"
+          "      or expiry (default DTN_CONF_DROP_POLICY)\n"
+          "  -O  spray order: fifo, copies (highest L first) or expiry\n"
+          "      (default DTN_CONF_SPRAY_ORDER)\n"
+          "  -A  fraction of the bundles sent as alarms, expedited with twice\n"
+          "      the copies and a delivery ack (default 0)\n"
+          "  -B  send every bundle as a message of this many bytes with\n"
+          "      dtn_send_bulk(), needs DTN_CONF_FRAG_MAX > 0\n"
+          "  -S  pad every message to this many bytes, without -B\n"
+          "  -Q  open every connection with dtn_open_pool() and a pool of\n"
+          "      this many bundles (default dtn_open() and DTN_CONF_QUEUE_MAX)\n"
+          "  -P  fixed transmit power level of every node, 0 to 18, lower\n"
+          "      levels reach less of the rwp and grid range (default 18)\n"
+          "  -G  nodes 0 to sinks - 1 join group 0, and every bundle is a\n"
+          "      reading of a non-sink for all of them, one group bundle with\n"
+          "      DTN_CONF_GROUPS > 0 or a copy per sink without; delivery\n"
+          "      counts a record per reading and sink\n"
+          "  -X  write each node's event trace to dir/<node>.events for\n"
+          "      dtn-trace, needs DTN_CONF_TRACE > 0\n"
+          "  -L  the last nodes run the version 1 module of v1/, the one\n"
+          "      deployed before the packed header, with plain messages only\n"
+          "      and not with -B, -G, -Q or -X (default 0)\n"
+          "  -N  scenario name for the JSON results (default \"sim\")\n"
+          "  -j  append the results as one JSON line to a file, - for stdout\n"
+          "  -s  random seed\n"
+          "  -v  print every delivery\n"
+          "\n"
+          "Without -M, -c or -T every node is in range of every other.\n",
+          prog);
+  exit(2);
+}
+/*---------------------------------------------------------------------------*/
+int
+main(int argc, char **argv)
+{
+  int nodes = 20, opt, i, model = MOBILITY_NONE;
+  double duration = 600, window = -1, reboot = -1;
+  float loss = 0;
+  const char *contacts = NULL, *trace = NULL, *record = NULL, *json = NULL;
+  const char *name = "sim", *events = NULL;
+  struct mobility_conf mconf = {1000, 1000, 100, 0.5, 1.5, 60, 1, 0};
+  FILE *record_f = NULL;
+  struct results r;
+  uint32_t seed = 1;
+
+  num_bundles = 100;
+  while((opt = getopt(argc, argv, "n:t:m:w:l:M:a:r:V:p:c:T:W:R:F:D:O:A:B:S:Q:P:G:X:L:N:j:s:v")) != -1) {
+    switch(opt) {
+    case 'n': nodes = atoi(optarg); break;
+    case 't': duration = atof(optarg); break;
+    case 'm': num_bundles = atoi(optarg); break;
+    case 'w': window = atof(optarg); break;
+    case 'l': loss = atof(optarg); break;
+    case 'M':
+      if((model = mobility_parse(optarg)) < 0) {
+        usage(argv[0]);
+      }
+      break;
+    case 'a':
+      if(sscanf(optarg, "%lfx%lf", &mconf.width, &mconf.height) != 2) {
+        usage(argv[0]);
+      }
+      break;
+    case 'r': mconf.range = atof(optarg); break;
+    case 'V':
+      if(sscanf(optarg, "%lf:%lf", &mconf.speed_min, &mconf.speed_max) != 2) {
+        usage(argv[0]);
+      }
+      break;
+    case 'p': mconf.pause_max = atof(optarg); break;
+    case 'c': contacts = optarg; break;
+    case 'T': trace = optarg; break;
+    case 'W': record = optarg; break;
+    case 'R': reboot = atof(optarg); break;
+    case 'F': sim_cfs_dir(optarg); break;
+    case 'D':
+      if((drop_policy = parse_name(drop_names, optarg)) < 0) {
+        usage(argv[0]);
+      }
+      break;
+    case 'O':
+      if((spray_order = parse_name(order_names, optarg)) < 0) {
+        usage(argv[0]);
+      }
+      break;
+    case 'A': alarms = atof(optarg); break;
+    case 'B': bulk = atoi(optarg); break;
+    case 'S': msg_size = atoi(optarg); break;
+    case 'Q': pool_size = atoi(optarg); break;
+    case 'P': power = atoi(optarg); break;
+    case 'G': sinks = atoi(optarg); break;
+    case 'X': events = optarg; break;
+    case 'L': v1_nodes = atoi(optarg); break;
+    case 'N': name = optarg; break;
+    case 'j': json = optarg; break;
+    case 's': seed = strtoul(optarg, NULL, 0); break;
+    case 'v': verbose = 1; break;
+    default: usage(argv[0]);
+    }
+  }
+  if(nodes < 2 || nodes > 65534 || duration <= 0 || num_bundles < 0
+     || pool_size < 0 || (pool_size == 0 && DTN_QUEUE_MAX == 0)) {
+    usage(argv[0]);
+  }
+  if(events != NULL && DTN_TRACE == 0) {
+    fprintf(stderr, "-X needs a build with DTN_CONF_TRACE > 0\n");
+    return 1;
+  }
+  if(power > SIM_POWER_MAX || (power >= 0 && DTN_POWER_CONTROL)) {
+    fprintf(stderr, "-P takes a level up to %d, in a build without "
+            "DTN_CONF_POWER_CONTROL\n", SIM_POWER_MAX);
+    return 1;
+  }
+  if(bulk < 0 || bulk > DTN_FRAG_MAX * DTN_FRAG_SIZE) {
+    fprintf(stderr, "-B needs a build with DTN_CONF_FRAG_MAX * "
+            "DTN_CONF_FRAG_SIZE >= %d\n", bulk);
+    return 1;
+  }
+  if(msg_size < 0 || msg_size > PACKETBUF_SIZE) {
+    fprintf(stderr, "-S takes up to %d bytes\n", PACKETBUF_SIZE);
+    return 1;
+  }
+  if(sinks < 0 || sinks >= nodes || (sinks > 0 && bulk > 0)
+     || (DTN_GROUPS && sinks > DTN_GROUP_MEMBERS)) {
+    fprintf(stderr, "-G takes fewer sinks than nodes, up to "
+            "DTN_CONF_GROUP_MEMBERS with groups, and not with -B\n");
+    return 1;
+  }
+  if(v1_nodes < 0 || v1_nodes > nodes
+     || (v1_nodes > 0 && (bulk > 0 || sinks > 0 || pool_size > 0
+                          || events != NULL))) {
+    fprintf(stderr, "-L takes up to as many nodes as there are, and not "
+            "with -B, -G, -Q or -X\n");
+    return 1;
+  }
+  if(window < 0 || window > duration) {
+    window = duration / 2;
+  }
+
+  sim_init(nodes, seed);
+  if(record != NULL) {
+    if((record_f = fopen(record, "w")) == NULL) {
+      perror(record);
+      return 1;
+    }
+    sim_trace_record(record_f);
+  }
+  if(contacts != NULL && sim_contacts_load(contacts, loss) < 0) {
+    perror(contacts);
+    return 1;
+  }
+  if(trace != NULL && sim_trace_load(trace, loss) < 0) {
+    perror(trace);
+    return 1;
+  }
+  if(model != MOBILITY_NONE) {
+    mconf.loss = loss;
+    mobility_start(model, &mconf);
+  } else if(contacts == NULL && trace == NULL) {
+    sim_link_set_all(loss);
+  }
+
+  apps = calloc(nodes, sizeof(struct app));
+  for(i = 0; i < nodes; i++) {
+    sim_nodes[i].app = &apps[i];
+    if(i >= nodes - v1_nodes) {
+      apps[i].v1 = dtn_v1_alloc();
+    }
+    if(pool_size > 0) {
+      pool_alloc(&apps[i].pool, pool_size);
+    }
+    sim_schedule(0, i, SIM_EV_CPU, node_boot, &apps[i]);
+    if(reboot >= 0) {
+      sim_schedule((uint64_t)(reboot * SIM_USEC_PER_SEC), i, SIM_EV_CPU,
+                   node_reboot, &apps[i]);
+    }
+    if(events != NULL && events_open(events, i) < 0) {
+      return 1;
+    }
+  }
+
+  if(sinks > 0) {
+    num_bundles *= sinks;
+  }
+  bundles = calloc(num_bundles ? num_bundles : 1, sizeof(struct bundle));
+  for(i = 0; i < num_bundles; i++) {
+    struct bundle *b = &bundles[i];
+    if(sinks > 0) {
+      b->dst = i % sinks;
+      if(b->dst > 0) { // the same reading as the record before
+        b->src = b[-1].src;
+        b->alarm = b[-1].alarm;
+        continue;
+      }
+      b->src = sinks + sim_rand() % (nodes - sinks);
+    } else {
+      b->src = sim_rand() % nodes;
+      do {
+        b->dst = sim_rand() % nodes;
+      } while(b->dst == b->src);
+    }
+    b->alarm = alarms > 0 && sim_rand_unit() < alarms;
+    sim_schedule(1 + (uint64_t)(sim_rand_unit() * window * SIM_USEC_PER_SEC),
+                 b->src, SIM_EV_CPU, sinks > 0 ? send_reading : send_bundle,
+                 (void *)(intptr_t)i);
+  }
+
+  sim_run((uint64_t)(duration * SIM_USEC_PER_SEC));
+  collect(&r);
+  report(&r, nodes, duration);
+  if(json != NULL) {
+    FILE *f = strcmp(json, "-") == 0 ? stdout : fopen(json, "a");
+    if(f == NULL) {
+      perror(json);
+      return 1;
+    }
+    report_json(f, &r, name, nodes, duration, seed);
+    if(f != stdout) {
+      fclose(f);
+    }
+  }
+
+  if(record_f != NULL) {
+    fclose(record_f);
+  }
+  for(i = 0; i < nodes; i++) {
+    if(apps[i].events != NULL) {
+      events_drain(&apps[i]);
+      fclose(apps[i].events);
+    }
+    free(apps[i].bundles);
+    if(pool_size > 0) {
+      pool_free(&apps[i].pool);
+    }
+    dtn_v1_free(apps[i].v1);
+  }
+  free(apps);
+  free(bundles);
+  mobility_free();
+  sim_free();
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,431 @@
+/**
+ * \file
+ *     Host-side analyser of the event traces of the \ref dtn module
+ *
+ *     Reads the event files that dtn-sim -X writes, one per node, each a
+ *     header and the records the node drained with dtn_trace_drain(). The
+ *     events of all nodes are merged by time and grouped by bundle. Every
+ *     bundle's propagation tree is rebuilt from the hand-offs: a node's
+ *     parent is the peer it first received a hand-off from, the origin is
+ *     the root and the destination hangs off whoever it got the bundle from.
+ *     The output is one line per bundle and a latency summary.
+ *
+ *     With -a the node clocks are not assumed to be synchronised. The offset
+ *     between two nodes is estimated from the hand-offs between them, as the
+ *     smallest receive time minus send time in each direction, and spread
+ *     from the first node over the graph of nodes that exchanged bundles.
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "dtn.h"
+
+#define EVENTS_VERSION 1
+
+struct events_hdr {
+  char magic[4];
+  uint8_t version;
+  uint8_t addr_size;
+  uint8_t rec_size;
+  uint8_t pad;
+  uint16_t clock_second;
+  rimeaddr_t addr;
+};
+
+struct node {
+  rimeaddr_t addr;
+  double offset;         /**< Subtracted from the node's times */
+  int aligned;
+  int parent;            /**< In the tree of the bundle being analysed */
+  double reached;
+  uint16_t num_copies;
+};
+
+struct event {
+  struct dtn_trace_rec r;
+  double t;              /**< Seconds */
+  int node;
+  int peer;              /**< Node index of r.peer, -1 if unknown or none */
+};
+
+static struct node *nodes;
+static int num_nodes;
+static struct event *events;
+static size_t num_events;
+static unsigned long lost;
+static const rimeaddr_t null_addr;
+
+static const char *event_names[] = {
+  "send", "spray-tx", "spray-rx", "request-tx", "request-rx", "handoff-tx",
+  "handoff-acked", "handoff-timedout", "handoff-rx", "deliver", "duplicate",
+  "expire", "evict"
+};
+/*---------------------------------------------------------------------------*/
+static const char *
+addr_str(const rimeaddr_t *addr)
+{
+  static char buf[4][4 * RIMEADDR_SIZE];
+  static int i;
+  char *p = buf[i = (i + 1) % 4];
+  int j, n = 0;
+  for(j = 0; j < RIMEADDR_SIZE; j++) {
+    n += sprintf(p + n, j ? ".%u" : "%u", addr->u8[j]);
+  }
+  return p;
+}
+/*---------------------------------------------------------------------------*/
+/* The simulated Rime is not linked in, so addresses are compared here. */
+static int
+addr_eq(const rimeaddr_t *a, const rimeaddr_t *b)
+{
+  return memcmp(a, b, sizeof(rimeaddr_t)) == 0;
+}
+/*---------------------------------------------------------------------------*/
+static int
+node_index(const rimeaddr_t *addr)
+{
+  int i;
+  for(i = 0; i < num_nodes; i++) {
+    if(addr_eq(&nodes[i].addr, addr)) {
+      return i;
+    }
+  }
+  return -1;
+}
+/*---------------------------------------------------------------------------*/
+static int
+load(const char *path)
+{
+  struct events_hdr h;
+  struct dtn_trace_rec r;
+  FILE *f = fopen(path, "rb");
+
+  if(f == NULL) {
+    perror(path);
+    return -1;
+  }
+  if(fread(&h, sizeof(h), 1, f) != 1 || memcmp(h.magic, "DTNT", 4) != 0
+     || h.version != EVENTS_VERSION || h.addr_size != RIMEADDR_SIZE
+     || h.rec_size != sizeof(struct dtn_trace_rec) || h.clock_second == 0) {
+    fprintf(stderr, "%s: not an event file of this build\n", path);
+    fclose(f);
+    return -1;
+  }
+  nodes = realloc(nodes, (num_nodes + 1) * sizeof(struct node));
+  memset(&nodes[num_nodes], 0, sizeof(struct node));
+  nodes[num_nodes].addr = h.addr;
+  while(fread(&r, sizeof(r), 1, f) == 1) {
+    if(num_events % 1024 == 0) {
+      events = realloc(events, (num_events + 1024) * sizeof(struct event));
+    }
+    events[num_events].r = r;
+    events[num_events].t = (double)r.time / h.clock_second;
+    events[num_events].node = num_nodes;
+    num_events++;
+    lost += r.gap;
+  }
+  num_nodes++;
+  fclose(f);
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static int
+cmp_time(const void *a, const void *b)
+{
+  const struct event *x = a, *y = b;
+  if(x->t != y->t) {
+    return x->t < y->t ? -1 : 1;
+  }
+  return x->node - y->node;
+}
+/*---------------------------------------------------------------------------*/
+/* Orders by bundle, then by time. */
+static int
+cmp_bundle(const void *a, const void *b)
+{
+  const struct event *x = a, *y = b;
+  int c = memcmp(&x->r.esender, &y->r.esender, sizeof(rimeaddr_t));
+  if(c != 0) {
+    return c;
+  }
+  if(x->r.epacketid != y->r.epacketid) {
+    return x->r.epacketid < y->r.epacketid ? -1 : 1;
+  }
+  return cmp_time(a, b);
+}
+/*---------------------------------------------------------------------------*/
+static int
+cmp_double(const void *a, const void *b)
+{
+  double x = *(const double *)a, y = *(const double *)b;
+  return x < y ? -1 : x > y;
+}
+/*---------------------------------------------------------------------------*/
+static int
+same_bundle(const struct event *a, const struct event *b)
+{
+  return addr_eq(&a->r.esender, &b->r.esender)
+         && a->r.epacketid == b->r.epacketid;
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Estimate the clock offsets from the hand-offs, events sorted by bundle.
+ * d[a][b] is the smallest receive time at b minus the matching send time at
+ * a, so offset(b) - offset(a) lies between -d[b][a] and d[a][b].
+ */
+static void
+align(void)
+{
+  double *d = malloc((size_t)num_nodes * num_nodes * sizeof(double));
+  int *queue = malloc(num_nodes * sizeof(int));
+  int head = 0, tail = 0, a, b;
+  size_t i, j, start;
+
+  for(i = 0; i < (size_t)num_nodes * num_nodes; i++) {
+    d[i] = 1e300;
+  }
+  for(start = 0; start < num_events; start = i) {
+    for(i = start; i < num_events && same_bundle(&events[start], &events[i]);
+        i++);
+    for(j = start; j < i; j++) {
+      const struct event *rx = &events[j], *tx = NULL;
+      size_t k;
+      if(rx->r.event != DTN_TRACE_HANDOFF_RX || rx->peer < 0) {
+        continue;
+      }
+      for(k = start; k < i; k++) {
+        const struct event *e = &events[k];
+        if(e->r.event == DTN_TRACE_HANDOFF_TX && e->node == rx->peer
+           && e->peer == rx->node
+           && (tx == NULL || fabs(e->t - rx->t) < fabs(tx->t - rx->t))) {
+          tx = e;
+        }
+      }
+      if(tx != NULL && rx->t - tx->t < d[tx->node * num_nodes + rx->node]) {
+        d[tx->node * num_nodes + rx->node] = rx->t - tx->t;
+      }
+    }
+  }
+
+  nodes[0].aligned = 1;
+  queue[tail++] = 0;
+  while(head < tail) {
+    a = queue[head++];
+    for(b = 0; b < num_nodes; b++) {
+      double ab = d[a * num_nodes + b], ba = d[b * num_nodes + a];
+      if(nodes[b].aligned || (ab >= 1e300 && ba >= 1e300)) {
+        continue;
+      }
+      if(ab < 1e300 && ba < 1e300) {
+        nodes[b].offset = nodes[a].offset + (ab - ba) / 2;
+      } else if(ab < 1e300) {
+        nodes[b].offset = nodes[a].offset + ab;
+      } else {
+        nodes[b].offset = nodes[a].offset - ba;
+      }
+      nodes[b].aligned = 1;
+      queue[tail++] = b;
+    }
+  }
+  for(a = 0; a < num_nodes; a++) {
+    if(!nodes[a].aligned) {
+      fprintf(stderr, "node %s exchanged no hand-offs, not aligned\n",
+              addr_str(&nodes[a].addr));
+    } else if(nodes[a].offset != 0) {
+      printf("clock %s offset %+.3f s\n", addr_str(&nodes[a].addr),
+             nodes[a].offset);
+    }
+  }
+  for(i = 0; i < num_events; i++) {
+    events[i].t -= nodes[events[i].node].offset;
+  }
+  free(queue);
+  free(d);
+}
+/*---------------------------------------------------------------------------*/
+static void
+print_tree(int n, int depth)
+{
+  int i;
+  printf("    %*s%s at %.3f s, L=%u\n", 2 * depth, "",
+         addr_str(&nodes[n].addr), nodes[n].reached, nodes[n].num_copies);
+  for(i = 0; i < num_nodes; i++) {
+    if(nodes[i].parent == n && i != n) {
+      print_tree(i, depth + 1);
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Rebuild the tree of the bundle in events[start..end). Returns its latency
+ * in seconds, -1 if it was not delivered or -2 if it was not sent in the
+ * trace.
+ */
+static double
+bundle(size_t start, size_t end, int trees)
+{
+  const struct event *send = NULL, *deliver = NULL;
+  int i, origin, dest = -1, reached = 0, depth = 0, d, n;
+  size_t j;
+
+  for(i = 0; i < num_nodes; i++) {
+    nodes[i].parent = -2;
+  }
+  for(j = start; j < end; j++) {
+    const struct event *e = &events[j];
+    if(e->r.event == DTN_TRACE_SEND && send == NULL) {
+      send = e;
+      nodes[e->node].parent = -1;
+      nodes[e->node].reached = e->t;
+      nodes[e->node].num_copies = e->r.num_copies;
+      dest = node_index(&e->r.peer);
+    } else if(e->r.event == DTN_TRACE_HANDOFF_RX
+              && nodes[e->node].parent == -2) {
+      nodes[e->node].parent = e->peer;
+      nodes[e->node].reached = e->t;
+      nodes[e->node].num_copies = e->r.num_copies;
+    } else if(e->r.event == DTN_TRACE_DELIVER && deliver == NULL) {
+      size_t k;
+      deliver = e;
+      for(k = j; k-- > start;) {
+        const struct event *p = &events[k];
+        if(p->node == e->node && (p->r.event == DTN_TRACE_HANDOFF_RX
+                                  || p->r.event == DTN_TRACE_SPRAY_RX)) {
+          nodes[e->node].parent = p->peer;
+          break;
+        }
+      }
+      nodes[e->node].reached = e->t;
+      nodes[e->node].num_copies = e->r.num_copies;
+    }
+  }
+  if(send == NULL) {
+    /* Created before the trace started or its record was lost */
+    return -2;
+  }
+  origin = send->node;
+  for(i = 0; i < num_nodes; i++) {
+    if(nodes[i].parent == -2) {
+      continue;
+    }
+    reached++;
+    for(d = 0, n = i; n >= 0 && n != origin && d <= num_nodes; d++) {
+      n = nodes[n].parent;
+    }
+    if(n == origin && d > depth) {
+      depth = d;
+    }
+  }
+
+  printf("%s #%u -> %s created %.3f s", addr_str(&send->r.esender),
+         send->r.epacketid, dest >= 0 ? addr_str(&nodes[dest].addr) : "?",
+         send->t);
+  if(deliver != NULL) {
+    printf(" delivered %.3f s latency %.3f s", deliver->t,
+           deliver->t - send->t);
+  } else {
+    printf(" not delivered");
+  }
+  printf(" reached %d depth %d\n", reached, depth);
+  if(trees) {
+    print_tree(origin, 0);
+  }
+  return deliver != NULL ? deliver->t - send->t : -1;
+}
+/*---------------------------------------------------------------------------*/
+static void
+usage(const char *prog)
+{
+  fprintf(stderr,
+          "usage: %s [-m] [-t] [-a] file.events...\n"
+          "\n"
+          "  -m  print the merged timeline of all events\n"
+          "  -t  print the propagation tree of every bundle\n"
+          "  -a  estimate and remove the offsets between the node clocks\n",
+          prog);
+  exit(2);
+}
+/*---------------------------------------------------------------------------*/
+int
+main(int argc, char **argv)
+{
+  int opt, merged = 0, trees = 0, aligned = 0, sent = 0, delivered = 0;
+  double *lat, sum = 0;
+  size_t i, start;
+
+  while((opt = getopt(argc, argv, "mta")) != -1) {
+    switch(opt) {
+    case 'm': merged = 1; break;
+    case 't': trees = 1; break;
+    case 'a': aligned = 1; break;
+    default: usage(argv[0]);
+    }
+  }
+  if(optind >= argc) {
+    usage(argv[0]);
+  }
+  for(; optind < argc; optind++) {
+    if(load(argv[optind]) < 0) {
+      return 1;
+    }
+  }
+  for(i = 0; i < num_events; i++) {
+    events[i].peer = addr_eq(&events[i].r.peer, &null_addr)
+                     ? -1 : node_index(&events[i].r.peer);
+  }
+
+  qsort(events, num_events, sizeof(struct event), cmp_bundle);
+  if(aligned) {
+    align();
+    qsort(events, num_events, sizeof(struct event), cmp_bundle);
+  }
+
+  lat = malloc((num_events + 1) * sizeof(double));
+  for(start = 0; start < num_events; start = i) {
+    double l;
+    for(i = start; i < num_events && same_bundle(&events[start], &events[i]);
+        i++);
+    l = bundle(start, i, trees);
+    sent += l > -2;
+    if(l >= 0) {
+      lat[delivered++] = l;
+      sum += l;
+    }
+  }
+
+  if(merged) {
+    qsort(events, num_events, sizeof(struct event), cmp_time);
+    for(i = 0; i < num_events; i++) {
+      const struct event *e = &events[i];
+      printf("%.3f %s %s %s #%u L=%u", e->t, addr_str(&nodes[e->node].addr),
+             e->r.event < sizeof(event_names) / sizeof(event_names[0])
+             ? event_names[e->r.event] : "?",
+             addr_str(&e->r.esender), e->r.epacketid, e->r.num_copies);
+      if(!addr_eq(&e->r.peer, &null_addr)) {
+        printf(" peer %s", addr_str(&e->r.peer));
+      }
+      printf("\n");
+    }
+  }
+
+  qsort(lat, delivered, sizeof(double), cmp_double);
+  printf("nodes                %d\n", num_nodes);
+  printf("events               %lu (%lu lost)\n", (unsigned long)num_events,
+         lost);
+  printf("bundles              %d\n", sent);
+  printf("delivered            %d\n", delivered);
+  if(delivered) {
+    printf("latency mean/median  %.3f / %.3f s\n", sum / delivered,
+           lat[(delivered - 1) / 2]);
+    printf("latency p99/max      %.3f / %.3f s\n",
+           lat[(int)(0.99 * delivered + 0.999999) - 1], lat[delivered - 1]);
+  }
+  free(lat);
+  free(events);
+  free(nodes);
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
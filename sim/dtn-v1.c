@@ -0,0 +1,88 @@
+/**
+ * \file
+ *     The version 1 DTN module under renamed symbols, see dtn-v1.h
+ */
+#include <stdlib.h>
+
+#define csvlog_packetbuf v1_csvlog_packetbuf
+#define dtn_buf_ptr v1_dtn_buf_ptr
+#define dtn_close v1_dtn_close
+#define dtn_delay v1_dtn_delay
+#define dtn_handoff_call v1_dtn_handoff_call
+#define dtn_handoff_recv v1_dtn_handoff_recv
+#define dtn_handoff_sent v1_dtn_handoff_sent
+#define dtn_handoff_timedout v1_dtn_handoff_timedout
+#define dtn_open v1_dtn_open
+#define dtn_queue_find v1_dtn_queue_find
+#define dtn_queue_spray v1_dtn_queue_spray
+#define dtn_request_call v1_dtn_request_call
+#define dtn_request_recv v1_dtn_request_recv
+#define dtn_send v1_dtn_send
+#define dtn_set_addr v1_dtn_set_addr
+#define dtn_set_power v1_dtn_set_power
+#define dtn_spray_call v1_dtn_spray_call
+#define dtn_spray_recv v1_dtn_spray_recv
+#define dtn_valid_hdr v1_dtn_valid_hdr
+#define print_packetbuf v1_print_packetbuf
+
+/* Built as released, warnings and all */
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-variable"
+#pragma GCC diagnostic ignored "-Wparentheses"
+#pragma GCC diagnostic ignored "-Warray-bounds"
+#include "v1/dtn.c"
+#pragma GCC diagnostic pop
+
+#include "dtn-v1.h"
+
+struct dtn_v1 {
+  struct dtn_conn c;
+  dtn_v1_recv_fn recv;
+};
+/*---------------------------------------------------------------------------*/
+static void
+recv(struct dtn_conn *c, const rimeaddr_t *from, uint16_t packetid)
+{
+  struct dtn_v1 *v = (struct dtn_v1 *)c;
+  v->recv(from, packetid, packetbuf_dataptr(), packetbuf_datalen());
+}
+/*---------------------------------------------------------------------------*/
+static const struct dtn_callbacks callbacks = {recv};
+/*---------------------------------------------------------------------------*/
+struct dtn_v1 *
+dtn_v1_alloc(void)
+{
+  return calloc(1, sizeof(struct dtn_v1));
+}
+/*---------------------------------------------------------------------------*/
+void
+dtn_v1_free(struct dtn_v1 *v)
+{
+  free(v);
+}
+/*---------------------------------------------------------------------------*/
+void
+dtn_v1_open(struct dtn_v1 *v, uint16_t dtn_channel, dtn_v1_recv_fn recv)
+{
+  v->recv = recv;
+  v1_dtn_open(&v->c, dtn_channel, &callbacks);
+}
+/*---------------------------------------------------------------------------*/
+void
+dtn_v1_close(struct dtn_v1 *v)
+{
+  v1_dtn_close(&v->c);
+}
+/*---------------------------------------------------------------------------*/
+int
+dtn_v1_send(struct dtn_v1 *v, const rimeaddr_t *to)
+{
+  return v1_dtn_send(&v->c, to);
+}
+/*---------------------------------------------------------------------------*/
+uint16_t
+dtn_v1_seqno(struct dtn_v1 *v)
+{
+  return v->c.seqno;
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,36 @@
+/**
+ * \file
+ *     The version 1 DTN module, as deployed before the packed header, for
+ *     the simulator's mixed-version runs
+ *
+ *     The module in v1/ is kept as it was released and built under renamed
+ *     symbols, so that it links next to the current one. Its connections
+ *     are opaque to the simulator, which only needs to boot, feed and
+ *     close them.
+ */
+#ifndef DTN_V1_H
+#define DTN_V1_H
+
+#include "net/rime.h"
+
+/** A connection of the version 1 module */
+struct dtn_v1;
+
+/** Called with a message delivered to a version 1 node */
+typedef void (* dtn_v1_recv_fn)(const rimeaddr_t *from, uint16_t packetid,
+                                const uint8_t *data, uint16_t len);
+
+struct dtn_v1 *dtn_v1_alloc(void);
+void dtn_v1_free(struct dtn_v1 *v);
+
+/** Open v on dtn_channel and the two channels after it */
+void dtn_v1_open(struct dtn_v1 *v, uint16_t dtn_channel, dtn_v1_recv_fn recv);
+void dtn_v1_close(struct dtn_v1 *v);
+
+/** Send the data in the packet buffer, 0 if the queue is full */
+int dtn_v1_send(struct dtn_v1 *v, const rimeaddr_t *to);
+
+/** Sequence number of the next message v sends */
+uint16_t dtn_v1_seqno(struct dtn_v1 *v);
+
+#endif /* DTN_V1_H */
@@ -0,0 +1,29 @@
+/**
+ * \file
+ *     Platform configuration for the host-native DTN simulator
+ */
+#ifndef CONTIKI_CONF_H
+#define CONTIKI_CONF_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define CLOCK_CONF_SECOND 128
+typedef unsigned long clock_time_t;
+
+#ifndef RIMEADDR_CONF_SIZE
+#define RIMEADDR_CONF_SIZE 2
+#endif
+
+#ifndef PACKETBUF_CONF_SIZE
+#define PACKETBUF_CONF_SIZE 128
+#endif
+
+#ifndef QUEUEBUF_CONF_NUM
+#define QUEUEBUF_CONF_NUM 8
+#endif
+
+/* Radio driver call provided by the OrisenPrime platform. */
+void set_power(uint8_t power);
+
+#endif /* CONTIKI_CONF_H */
@@ -0,0 +1,14 @@
+/**
+ * \file
+ *     Subset of the Contiki core used by the DTN module, for the simulator
+ */
+#ifndef CONTIKI_H
+#define CONTIKI_H
+
+#include "contiki-conf.h"
+#include "sys/clock.h"
+#include "sys/timer.h"
+#include "sys/ctimer.h"
+#include "lib/random.h"
+
+#endif /* CONTIKI_H */
@@ -0,0 +1,13 @@
+/**
+ * \file
+ *     Per-node pseudo-random number generator
+ */
+#ifndef RANDOM_H
+#define RANDOM_H
+
+#define RANDOM_RAND_MAX 65535U
+
+void random_init(unsigned short seed);
+unsigned short random_rand(void);
+
+#endif /* RANDOM_H */
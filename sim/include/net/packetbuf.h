@@ -0,0 +1,35 @@
+/**
+ * \file
+ *     The Rime packet buffer, with the same layout rules as Contiki's
+ */
+#ifndef PACKETBUF_H
+#define PACKETBUF_H
+
+#include "contiki-conf.h"
+#include "net/rime/rimeaddr.h"
+
+#define PACKETBUF_SIZE PACKETBUF_CONF_SIZE
+#define PACKETBUF_HDR_SIZE 48
+
+void packetbuf_clear(void);
+int packetbuf_copyfrom(const void *from, uint16_t len);
+int packetbuf_copyto(void *to);
+int packetbuf_hdralloc(int size);
+int packetbuf_hdrreduce(int size);
+void *packetbuf_dataptr(void);
+void *packetbuf_hdrptr(void);
+uint16_t packetbuf_datalen(void);
+uint8_t packetbuf_hdrlen(void);
+uint16_t packetbuf_totlen(void);
+void packetbuf_set_datalen(uint16_t len);
+
+enum {
+  PACKETBUF_ADDR_SENDER,
+  PACKETBUF_ADDR_RECEIVER,
+  PACKETBUF_ADDR_MAX
+};
+
+const rimeaddr_t *packetbuf_addr(uint8_t type);
+int packetbuf_set_addr(uint8_t type, const rimeaddr_t *addr);
+
+#endif /* PACKETBUF_H */
@@ -0,0 +1,40 @@
+/**
+ * \file
+ *     Packet queues with per-packet lifetimes
+ */
+#ifndef PACKETQUEUE_H
+#define PACKETQUEUE_H
+
+#include "net/queuebuf.h"
+#include "sys/ctimer.h"
+
+/*
+ * The queue contents live in the simulator's per-node state, keyed by the
+ * address of the struct packetqueue, so that a queue declared statically in
+ * module code is private to each simulated node.
+ */
+#define PACKETQUEUE(name, size) \
+  static struct packetqueue name = { size }
+
+struct packetqueue {
+  int max_len;
+};
+
+struct packetqueue_item {
+  struct packetqueue_item *next;
+  struct queuebuf *buf;
+  struct packetqueue *queue;
+  struct ctimer lifetimer;
+  void *ptr;
+};
+
+void packetqueue_init(struct packetqueue *q);
+struct packetqueue_item *packetqueue_first(struct packetqueue *q);
+int packetqueue_enqueue_packetbuf(struct packetqueue *q, clock_time_t lifetime,
+                                  void *ptr);
+void packetqueue_dequeue(struct packetqueue *q);
+int packetqueue_len(struct packetqueue *q);
+struct queuebuf *packetqueue_queuebuf(struct packetqueue_item *i);
+void *packetqueue_ptr(struct packetqueue_item *i);
+
+#endif /* PACKETQUEUE_H */
@@ -0,0 +1,23 @@
+/**
+ * \file
+ *     Queue buffers: copies of the packet buffer kept for later use
+ */
+#ifndef QUEUEBUF_H
+#define QUEUEBUF_H
+
+#include "net/packetbuf.h"
+
+#define QUEUEBUF_NUM QUEUEBUF_CONF_NUM
+
+struct queuebuf;
+
+void queuebuf_init(void);
+struct queuebuf *queuebuf_new_from_packetbuf(void);
+void queuebuf_update_attr_from_packetbuf(struct queuebuf *b);
+void queuebuf_to_packetbuf(struct queuebuf *b);
+void queuebuf_free(struct queuebuf *b);
+void *queuebuf_dataptr(struct queuebuf *b);
+int queuebuf_datalen(struct queuebuf *b);
+const rimeaddr_t *queuebuf_addr(struct queuebuf *b, uint8_t type);
+
+#endif /* QUEUEBUF_H */
@@ -0,0 +1,17 @@
+/**
+ * \file
+ *     Rime stack subset implemented by the host-native DTN simulator
+ */
+#ifndef RIME_H
+#define RIME_H
+
+#include "contiki.h"
+#include "net/rime/rimeaddr.h"
+#include "net/packetbuf.h"
+#include "net/queuebuf.h"
+#include "net/packetqueue.h"
+#include "net/rime/broadcast.h"
+#include "net/rime/unicast.h"
+#include "net/rime/runicast.h"
+
+#endif /* RIME_H */
@@ -0,0 +1,27 @@
+/**
+ * \file
+ *     Best-effort local area broadcast
+ */
+#ifndef BROADCAST_H
+#define BROADCAST_H
+
+#include "net/rime/channel.h"
+
+struct broadcast_conn;
+
+struct broadcast_callbacks {
+  void (* recv)(struct broadcast_conn *ptr, const rimeaddr_t *sender);
+  void (* sent)(struct broadcast_conn *ptr, int status, int num_tx);
+};
+
+struct broadcast_conn {
+  struct channel channel;
+  const struct broadcast_callbacks *u;
+};
+
+void broadcast_open(struct broadcast_conn *c, uint16_t channel,
+                    const struct broadcast_callbacks *u);
+void broadcast_close(struct broadcast_conn *c);
+int broadcast_send(struct broadcast_conn *c);
+
+#endif /* BROADCAST_H */
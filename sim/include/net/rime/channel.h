@@ -0,0 +1,22 @@
+/**
+ * \file
+ *     Rime channels, as registered with the simulated radio
+ */
+#ifndef CHANNEL_H
+#define CHANNEL_H
+
+#include "net/rime/rimeaddr.h"
+
+enum {
+  CHANNEL_BROADCAST,
+  CHANNEL_UNICAST,
+  CHANNEL_RUNICAST
+};
+
+struct channel {
+  struct channel *next;
+  uint16_t channelno;
+  uint8_t type;
+};
+
+#endif /* CHANNEL_H */
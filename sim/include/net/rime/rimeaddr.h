@@ -0,0 +1,23 @@
+/**
+ * \file
+ *     Rime addresses
+ */
+#ifndef RIMEADDR_H
+#define RIMEADDR_H
+
+#include "contiki-conf.h"
+
+#define RIMEADDR_SIZE RIMEADDR_CONF_SIZE
+
+typedef union {
+  unsigned char u8[RIMEADDR_SIZE];
+} rimeaddr_t;
+
+void rimeaddr_copy(rimeaddr_t *dest, const rimeaddr_t *from);
+int rimeaddr_cmp(const rimeaddr_t *addr1, const rimeaddr_t *addr2);
+void rimeaddr_set_node_addr(rimeaddr_t *addr);
+
+extern rimeaddr_t rimeaddr_node_addr;
+extern const rimeaddr_t rimeaddr_null;
+
+#endif /* RIMEADDR_H */
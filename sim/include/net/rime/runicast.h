@@ -0,0 +1,44 @@
+/**
+ * \file
+ *     Reliable single-hop unicast
+ */
+#ifndef RUNICAST_H
+#define RUNICAST_H
+
+#include "net/rime/channel.h"
+#include "sys/ctimer.h"
+
+#define RUNICAST_PACKET_ID_BITS 2
+
+struct runicast_conn;
+
+struct runicast_callbacks {
+  void (* recv)(struct runicast_conn *c, const rimeaddr_t *from,
+                uint8_t seqno);
+  void (* sent)(struct runicast_conn *c, const rimeaddr_t *to,
+                uint8_t retransmissions);
+  void (* timedout)(struct runicast_conn *c, const rimeaddr_t *to,
+                    uint8_t retransmissions);
+};
+
+struct runicast_conn {
+  struct channel channel;
+  const struct runicast_callbacks *u;
+  struct ctimer rxmit_timer;
+  uint8_t *frame;          /**< Frame being transmitted, owned by the sim */
+  uint16_t frame_len;
+  rimeaddr_t receiver;
+  uint8_t sndnxt;
+  uint8_t is_tx;
+  uint8_t rxmit;
+  uint8_t max_rxmit;
+};
+
+void runicast_open(struct runicast_conn *c, uint16_t channel,
+                   const struct runicast_callbacks *u);
+void runicast_close(struct runicast_conn *c);
+int runicast_send(struct runicast_conn *c, const rimeaddr_t *receiver,
+                  uint8_t max_retransmissions);
+uint8_t runicast_is_transmitting(struct runicast_conn *c);
+
+#endif /* RUNICAST_H */
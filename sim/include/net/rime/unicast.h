@@ -0,0 +1,27 @@
+/**
+ * \file
+ *     Single-hop unicast
+ */
+#ifndef UNICAST_H
+#define UNICAST_H
+
+#include "net/rime/channel.h"
+
+struct unicast_conn;
+
+struct unicast_callbacks {
+  void (* recv)(struct unicast_conn *c, const rimeaddr_t *from);
+  void (* sent)(struct unicast_conn *ptr, int status, int num_tx);
+};
+
+struct unicast_conn {
+  struct channel channel;
+  const struct unicast_callbacks *u;
+};
+
+void unicast_open(struct unicast_conn *c, uint16_t channel,
+                  const struct unicast_callbacks *u);
+void unicast_close(struct unicast_conn *c);
+int unicast_send(struct unicast_conn *c, const rimeaddr_t *receiver);
+
+#endif /* UNICAST_H */
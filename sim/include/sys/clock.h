@@ -0,0 +1,23 @@
+/**
+ * \file
+ *     Simulated clock, driven by the simulator's virtual time
+ */
+#ifndef CLOCK_H
+#define CLOCK_H
+
+#include "contiki-conf.h"
+
+#define CLOCK_SECOND CLOCK_CONF_SECOND
+
+clock_time_t clock_time(void);
+unsigned long clock_seconds(void);
+
+/**
+ * Busy-wait. In the simulator this does not spin; it advances the calling
+ * node's local time so that everything it does afterwards, including any
+ * frame it transmits, happens later.
+ */
+void clock_delay_usec(uint16_t dt);
+void clock_delay_msec(uint16_t dt);
+
+#endif /* CLOCK_H */
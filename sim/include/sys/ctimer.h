@@ -0,0 +1,27 @@
+/**
+ * \file
+ *     Simulated callback timers
+ */
+#ifndef CTIMER_H
+#define CTIMER_H
+
+#include "sys/clock.h"
+
+struct ctimer {
+  clock_time_t start;
+  clock_time_t interval;
+  void (*f)(void *);
+  void *ptr;
+  void *ticket;        /**< Pending simulator event, NULL when stopped */
+  uint8_t active;
+  int node;            /**< Index of the node that armed the timer */
+};
+
+void ctimer_set(struct ctimer *c, clock_time_t t,
+                void (*f)(void *), void *ptr);
+void ctimer_reset(struct ctimer *c);
+void ctimer_restart(struct ctimer *c);
+void ctimer_stop(struct ctimer *c);
+int ctimer_expired(struct ctimer *c);
+
+#endif /* CTIMER_H */
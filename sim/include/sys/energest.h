@@ -0,0 +1,24 @@
+/**
+ * \file
+ *     Energest, with the radio always on and its transmit time taken from
+ *     the simulated airtime of the node's frames
+ */
+#ifndef ENERGEST_H
+#define ENERGEST_H
+
+#include "sys/rtimer.h"
+
+enum energest_type {
+  ENERGEST_TYPE_CPU,
+  ENERGEST_TYPE_LPM,
+  ENERGEST_TYPE_DEEP_LPM,
+  ENERGEST_TYPE_TRANSMIT,
+  ENERGEST_TYPE_LISTEN,
+  ENERGEST_TYPE_MAX
+};
+
+/** Time the running node spent in the state so far, in rtimer ticks */
+unsigned long energest_type_time(int type);
+void energest_flush(void);
+
+#endif /* ENERGEST_H */
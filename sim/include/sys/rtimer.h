@@ -0,0 +1,13 @@
+/**
+ * \file
+ *     Real-time timer resolution, as Energest counts time in its ticks
+ */
+#ifndef RTIMER_H
+#define RTIMER_H
+
+#define RTIMER_ARCH_SECOND 32768
+#define RTIMER_SECOND RTIMER_ARCH_SECOND
+
+typedef unsigned short rtimer_clock_t;
+
+#endif /* RTIMER_H */
@@ -0,0 +1,143 @@
+/**
+ * \file
+ *     Mobility models that drive the simulator's link model
+ */
+#include "mobility.h"
+#include "sim.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct position {
+  double x, y;
+  double tx, ty;       /**< Current waypoint */
+  double speed;
+  double pause_until;
+};
+
+static struct position *pos;
+static struct mobility_conf conf;
+/*---------------------------------------------------------------------------*/
+int
+mobility_parse(const char *name)
+{
+  if(strcmp(name, "none") == 0 || strcmp(name, "mesh") == 0) {
+    return MOBILITY_NONE;
+  } else if(strcmp(name, "rwp") == 0) {
+    return MOBILITY_RWP;
+  } else if(strcmp(name, "grid") == 0) {
+    return MOBILITY_GRID;
+  }
+  return -1;
+}
+/*---------------------------------------------------------------------------*/
+static void
+update_links(void)
+{
+  int a, b;
+  double r2 = conf.range * conf.range;
+  for(a = 0; a < sim_num_nodes; a++) {
+    for(b = a + 1; b < sim_num_nodes; b++) {
+      double dx = pos[a].x - pos[b].x, dy = pos[a].y - pos[b].y;
+      sim_link_set(a, b, dx * dx + dy * dy <= r2 ? conf.loss : -1);
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+rwp_waypoint(struct position *p)
+{
+  p->tx = sim_rand_unit() * conf.width;
+  p->ty = sim_rand_unit() * conf.height;
+  p->speed = conf.speed_min
+             + sim_rand_unit() * (conf.speed_max - conf.speed_min);
+  if(p->speed <= 0) {
+    p->speed = 0.1;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+rwp_step(void *arg)
+{
+  double now = (double)sim_now / SIM_USEC_PER_SEC;
+  int i;
+  for(i = 0; i < sim_num_nodes; i++) {
+    struct position *p = &pos[i];
+    double dx, dy, dist, move;
+    if(now < p->pause_until) {
+      continue;
+    }
+    dx = p->tx - p->x;
+    dy = p->ty - p->y;
+    dist = sqrt(dx * dx + dy * dy);
+    move = p->speed * conf.step;
+    if(move >= dist) {
+      p->x = p->tx;
+      p->y = p->ty;
+      p->pause_until = now + sim_rand_unit() * conf.pause_max;
+      rwp_waypoint(p);
+    } else {
+      p->x += dx / dist * move;
+      p->y += dy / dist * move;
+    }
+  }
+  update_links();
+  sim_schedule(sim_now + (uint64_t)(conf.step * SIM_USEC_PER_SEC), -1,
+               SIM_EV_GLOBAL, rwp_step, NULL);
+}
+/*---------------------------------------------------------------------------*/
+void
+mobility_start(int model, const struct mobility_conf *c)
+{
+  int i, side;
+  if(model == MOBILITY_NONE) {
+    return;
+  }
+  conf = *c;
+  if(conf.step <= 0) {
+    conf.step = 1;
+  }
+  pos = calloc(sim_num_nodes, sizeof(struct position));
+  switch(model) {
+  case MOBILITY_RWP:
+    for(i = 0; i < sim_num_nodes; i++) {
+      pos[i].x = sim_rand_unit() * conf.width;
+      pos[i].y = sim_rand_unit() * conf.height;
+      rwp_waypoint(&pos[i]);
+    }
+    update_links();
+    sim_schedule((uint64_t)(conf.step * SIM_USEC_PER_SEC), -1,
+                 SIM_EV_GLOBAL, rwp_step, NULL);
+    break;
+  case MOBILITY_GRID:
+    side = (int)ceil(sqrt(sim_num_nodes));
+    for(i = 0; i < sim_num_nodes; i++) {
+      /* Diagonal neighbours are sqrt(2) * 0.9 ranges away, out of range */
+      pos[i].x = (i % side) * conf.range * 0.9;
+      pos[i].y = (i / side) * conf.range * 0.9;
+    }
+    update_links();
+    break;
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+mobility_free(void)
+{
+  free(pos);
+  pos = NULL;
+}
+/*---------------------------------------------------------------------------*/
+int
+mobility_reaches(int a, int b, double scale)
+{
+  double dx, dy, r = conf.range * scale;
+  if(pos == NULL) {
+    return 1;
+  }
+  dx = pos[a].x - pos[b].x;
+  dy = pos[a].y - pos[b].y;
+  return dx * dx + dy * dy <= r * r;
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,35 @@
+/**
+ * \file
+ *     Mobility models that drive the simulator's link model
+ */
+#ifndef MOBILITY_H
+#define MOBILITY_H
+
+enum {
+  MOBILITY_NONE,      /**< Links come from a contact plan, trace or mesh */
+  MOBILITY_RWP,       /**< Random waypoint */
+  MOBILITY_GRID       /**< Static grid, each node reaches its 4 neighbours */
+};
+
+struct mobility_conf {
+  double width;       /**< Area size in metres */
+  double height;
+  double range;       /**< Radio range in metres */
+  double speed_min;   /**< Random waypoint speed range in m/s */
+  double speed_max;
+  double pause_max;   /**< Random waypoint pause at each waypoint, seconds */
+  double step;        /**< Position update period, seconds */
+  float loss;         /**< Frame loss probability on links in range */
+};
+
+int mobility_parse(const char *name);
+void mobility_start(int model, const struct mobility_conf *conf);
+void mobility_free(void);
+
+/**
+ * Whether a at scale times the radio range reaches b, always so without a
+ * mobility model
+ */
+int mobility_reaches(int a, int b, double scale);
+
+#endif /* MOBILITY_H */
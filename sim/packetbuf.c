@@ -0,0 +1,115 @@
+/**
+ * \file
+ *     The Rime packet buffer. There is one buffer shared by all simulated
+ *     nodes, just as there is one per node in Contiki: it never holds data
+ *     across events.
+ */
+#include "sim.h"
+
+#include <string.h>
+
+static uint16_t buflen, bufptr;
+static uint8_t hdrptr = PACKETBUF_HDR_SIZE;
+static uint32_t packetbuf_aligned[(PACKETBUF_SIZE + PACKETBUF_HDR_SIZE + 3)
+                                  / 4];
+static uint8_t *packetbuf = (uint8_t *)packetbuf_aligned;
+static rimeaddr_t addrs[PACKETBUF_ADDR_MAX];
+/*---------------------------------------------------------------------------*/
+void
+packetbuf_clear(void)
+{
+  buflen = bufptr = 0;
+  hdrptr = PACKETBUF_HDR_SIZE;
+  memset(addrs, 0, sizeof(addrs));
+}
+/*---------------------------------------------------------------------------*/
+int
+packetbuf_copyfrom(const void *from, uint16_t len)
+{
+  uint16_t l;
+  packetbuf_clear();
+  l = len > PACKETBUF_SIZE ? PACKETBUF_SIZE : len;
+  memcpy(&packetbuf[PACKETBUF_HDR_SIZE], from, l);
+  buflen = l;
+  return l;
+}
+/*---------------------------------------------------------------------------*/
+int
+packetbuf_copyto(void *to)
+{
+  memcpy(to, &packetbuf[hdrptr], PACKETBUF_HDR_SIZE - hdrptr);
+  memcpy((uint8_t *)to + PACKETBUF_HDR_SIZE - hdrptr,
+         &packetbuf[PACKETBUF_HDR_SIZE + bufptr], buflen);
+  return PACKETBUF_HDR_SIZE - hdrptr + buflen;
+}
+/*---------------------------------------------------------------------------*/
+int
+packetbuf_hdralloc(int size)
+{
+  if(size >= 0 && hdrptr >= size && packetbuf_totlen() + size <= PACKETBUF_SIZE) {
+    hdrptr -= size;
+    return 1;
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+int
+packetbuf_hdrreduce(int size)
+{
+  if(size < 0 || buflen < size) {
+    return 0;
+  }
+  bufptr += size;
+  buflen -= size;
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+void *
+packetbuf_dataptr(void)
+{
+  return &packetbuf[PACKETBUF_HDR_SIZE + bufptr];
+}
+/*---------------------------------------------------------------------------*/
+void *
+packetbuf_hdrptr(void)
+{
+  return &packetbuf[hdrptr];
+}
+/*---------------------------------------------------------------------------*/
+uint16_t
+packetbuf_datalen(void)
+{
+  return buflen;
+}
+/*---------------------------------------------------------------------------*/
+uint8_t
+packetbuf_hdrlen(void)
+{
+  return PACKETBUF_HDR_SIZE - hdrptr;
+}
+/*---------------------------------------------------------------------------*/
+uint16_t
+packetbuf_totlen(void)
+{
+  return packetbuf_hdrlen() + packetbuf_datalen();
+}
+/*---------------------------------------------------------------------------*/
+void
+packetbuf_set_datalen(uint16_t len)
+{
+  buflen = len;
+}
+/*---------------------------------------------------------------------------*/
+const rimeaddr_t *
+packetbuf_addr(uint8_t type)
+{
+  return &addrs[type];
+}
+/*---------------------------------------------------------------------------*/
+int
+packetbuf_set_addr(uint8_t type, const rimeaddr_t *addr)
+{
+  rimeaddr_copy(&addrs[type], addr);
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
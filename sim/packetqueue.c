@@ -0,0 +1,141 @@
+/**
+ * \file
+ *     Packet queues, kept per simulated node
+ */
+#include "sim.h"
+
+#include <stdlib.h>
+
+struct sim_pq {
+  struct sim_pq *next;
+  struct packetqueue *key;
+  struct packetqueue_item *head;
+  int len;
+};
+/*---------------------------------------------------------------------------*/
+static struct sim_pq *
+lookup(struct packetqueue *q)
+{
+  struct sim_pq *pq;
+  for(pq = sim_current->queues; pq != NULL; pq = pq->next) {
+    if(pq->key == q) {
+      return pq;
+    }
+  }
+  pq = calloc(1, sizeof(struct sim_pq));
+  pq->key = q;
+  pq->next = sim_current->queues;
+  sim_current->queues = pq;
+  return pq;
+}
+/*---------------------------------------------------------------------------*/
+static void
+remove_item(struct sim_pq *pq, struct packetqueue_item *i)
+{
+  struct packetqueue_item **p;
+  for(p = &pq->head; *p != NULL; p = &(*p)->next) {
+    if(*p == i) {
+      *p = i->next;
+      pq->len--;
+      break;
+    }
+  }
+  ctimer_stop(&i->lifetimer);
+  queuebuf_free(i->buf);
+  free(i);
+}
+/*---------------------------------------------------------------------------*/
+static void
+remove_queued_packet(void *item)
+{
+  struct packetqueue_item *i = item;
+  remove_item(lookup(i->queue), i);
+}
+/*---------------------------------------------------------------------------*/
+void
+packetqueue_init(struct packetqueue *q)
+{
+  struct sim_pq *pq = lookup(q);
+  while(pq->head != NULL) {
+    remove_item(pq, pq->head);
+  }
+}
+/*---------------------------------------------------------------------------*/
+struct packetqueue_item *
+packetqueue_first(struct packetqueue *q)
+{
+  return lookup(q)->head;
+}
+/*---------------------------------------------------------------------------*/
+int
+packetqueue_enqueue_packetbuf(struct packetqueue *q, clock_time_t lifetime,
+                              void *ptr)
+{
+  struct sim_pq *pq = lookup(q);
+  struct packetqueue_item *i, **p;
+  if(pq->len >= q->max_len) {
+    return 0;
+  }
+  i = calloc(1, sizeof(struct packetqueue_item));
+  if(i == NULL) {
+    return 0;
+  }
+  i->buf = queuebuf_new_from_packetbuf();
+  if(i->buf == NULL) {
+    free(i);
+    return 0;
+  }
+  i->queue = q;
+  i->ptr = ptr;
+  for(p = &pq->head; *p != NULL; p = &(*p)->next);
+  *p = i;
+  pq->len++;
+  if(lifetime > 0) {
+    ctimer_set(&i->lifetimer, lifetime, remove_queued_packet, i);
+  }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+void
+packetqueue_dequeue(struct packetqueue *q)
+{
+  struct sim_pq *pq = lookup(q);
+  if(pq->head != NULL) {
+    remove_item(pq, pq->head);
+  }
+}
+/*---------------------------------------------------------------------------*/
+int
+packetqueue_len(struct packetqueue *q)
+{
+  return lookup(q)->len;
+}
+/*---------------------------------------------------------------------------*/
+struct queuebuf *
+packetqueue_queuebuf(struct packetqueue_item *i)
+{
+  return i != NULL ? i->buf : NULL;
+}
+/*---------------------------------------------------------------------------*/
+void *
+packetqueue_ptr(struct packetqueue_item *i)
+{
+  return i != NULL ? i->ptr : NULL;
+}
+/*---------------------------------------------------------------------------*/
+void
+sim_packetqueue_node_reset(struct sim_node *n)
+{
+  struct sim_node *prev = sim_current;
+  sim_enter(n);
+  while(n->queues != NULL) {
+    struct sim_pq *pq = n->queues;
+    while(pq->head != NULL) {
+      remove_item(pq, pq->head);
+    }
+    n->queues = pq->next;
+    free(pq);
+  }
+  sim_current = prev;
+}
+/*---------------------------------------------------------------------------*/
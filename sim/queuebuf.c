@@ -0,0 +1,89 @@
+/**
+ * \file
+ *     Queue buffers. Each simulated node has its own pool of QUEUEBUF_NUM.
+ */
+#include "sim.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+struct queuebuf {
+  int node;
+  uint16_t len;
+  rimeaddr_t addrs[PACKETBUF_ADDR_MAX];
+  uint8_t data[PACKETBUF_SIZE + PACKETBUF_HDR_SIZE];
+};
+/*---------------------------------------------------------------------------*/
+void
+queuebuf_init(void)
+{
+}
+/*---------------------------------------------------------------------------*/
+struct queuebuf *
+queuebuf_new_from_packetbuf(void)
+{
+  struct queuebuf *b;
+  int i;
+  if(sim_current == NULL || sim_current->queuebufs >= QUEUEBUF_NUM) {
+    return NULL;
+  }
+  b = malloc(sizeof(struct queuebuf));
+  if(b == NULL) {
+    return NULL;
+  }
+  sim_current->queuebufs++;
+  b->node = sim_current->id;
+  b->len = packetbuf_copyto(b->data);
+  for(i = 0; i < PACKETBUF_ADDR_MAX; i++) {
+    rimeaddr_copy(&b->addrs[i], packetbuf_addr(i));
+  }
+  return b;
+}
+/*---------------------------------------------------------------------------*/
+void
+queuebuf_update_attr_from_packetbuf(struct queuebuf *b)
+{
+  int i;
+  for(i = 0; i < PACKETBUF_ADDR_MAX; i++) {
+    rimeaddr_copy(&b->addrs[i], packetbuf_addr(i));
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+queuebuf_to_packetbuf(struct queuebuf *b)
+{
+  int i;
+  packetbuf_copyfrom(b->data, b->len);
+  for(i = 0; i < PACKETBUF_ADDR_MAX; i++) {
+    packetbuf_set_addr(i, &b->addrs[i]);
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+queuebuf_free(struct queuebuf *b)
+{
+  if(b == NULL) {
+    return;
+  }
+  sim_nodes[b->node].queuebufs--;
+  free(b);
+}
+/*---------------------------------------------------------------------------*/
+void *
+queuebuf_dataptr(struct queuebuf *b)
+{
+  return b != NULL ? b->data : NULL;
+}
+/*---------------------------------------------------------------------------*/
+int
+queuebuf_datalen(struct queuebuf *b)
+{
+  return b->len;
+}
+/*---------------------------------------------------------------------------*/
+const rimeaddr_t *
+queuebuf_addr(struct queuebuf *b, uint8_t type)
+{
+  return &b->addrs[type];
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,464 @@
+/**
+ * \file
+ *     Simulated Rime: addresses and the broadcast, unicast and runicast
+ *     primitives over the simulator's link model
+ */
+#include "sim.h"
+#include "mobility.h"
+#include "sys/energest.h"
+
+#include <math.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* 802.15.4 at 250 kbit/s, plus PHY, MAC and Rime headers */
+#define US_PER_BYTE 32
+#define FRAME_OVERHEAD 21
+
+/*
+ * CC2420-like radio: the power levels span 25 dB, and sending draws from
+ * 8.5 mA at the lowest to 17.4 mA at the highest, at 3 V
+ */
+#define POWER_SPAN_DB 25.0
+#define TX_UA_MIN 8500
+#define TX_UA_MAX 17400
+#define SUPPLY_V 3
+
+#define REXMIT_TIME CLOCK_SECOND
+
+struct frame {
+  int src;
+  int dst;                /**< -1 for broadcast */
+  uint16_t channelno;
+  uint8_t type;
+  uint8_t ack;
+  uint8_t seqno;
+  uint16_t len;
+  uint8_t data[PACKETBUF_SIZE + PACKETBUF_HDR_SIZE];
+};
+
+rimeaddr_t rimeaddr_node_addr;
+const rimeaddr_t rimeaddr_null;
+
+static uint64_t *tx_free_at;
+static int tx_free_len;
+/*-RIMEADDR------------------------------------------------------------------*/
+void
+rimeaddr_copy(rimeaddr_t *dest, const rimeaddr_t *src)
+{
+  memcpy(dest, src, RIMEADDR_SIZE);
+}
+/*---------------------------------------------------------------------------*/
+int
+rimeaddr_cmp(const rimeaddr_t *addr1, const rimeaddr_t *addr2)
+{
+  return memcmp(addr1, addr2, RIMEADDR_SIZE) == 0;
+}
+/*---------------------------------------------------------------------------*/
+void
+rimeaddr_set_node_addr(rimeaddr_t *addr)
+{
+  rimeaddr_copy(&rimeaddr_node_addr, addr);
+  if(sim_current != NULL) {
+    rimeaddr_copy(&sim_current->addr, addr);
+  }
+}
+/*-RADIO DRIVER--------------------------------------------------------------*/
+void
+set_power(uint8_t power)
+{
+  if(sim_current != NULL) {
+    sim_current->tx_power = power;
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Fraction of the full range that the node's power level reaches. */
+static double
+power_range(uint8_t power)
+{
+  if(power >= SIM_POWER_MAX) {
+    return 1;
+  }
+  return pow(10, -POWER_SPAN_DB * (SIM_POWER_MAX - power) / SIM_POWER_MAX
+                 / 20);
+}
+/*---------------------------------------------------------------------------*/
+static uint32_t
+power_current_ua(uint8_t power)
+{
+  if(power >= SIM_POWER_MAX) {
+    return TX_UA_MAX;
+  }
+  return TX_UA_MIN + (uint32_t)(TX_UA_MAX - TX_UA_MIN) * power / SIM_POWER_MAX;
+}
+/*---------------------------------------------------------------------------*/
+unsigned long
+energest_type_time(int type)
+{
+  uint64_t us;
+  if(sim_current == NULL) {
+    return 0;
+  }
+  switch(type) {
+  case ENERGEST_TYPE_TRANSMIT:
+    us = sim_current->stats.tx_us;
+    break;
+  case ENERGEST_TYPE_LISTEN:
+    us = sim_local_time() - sim_current->stats.tx_us;
+    break;
+  default:
+    return 0;
+  }
+  return (unsigned long)(us * RTIMER_SECOND / SIM_USEC_PER_SEC);
+}
+/*---------------------------------------------------------------------------*/
+void
+energest_flush(void)
+{
+}
+/*-CHANNELS------------------------------------------------------------------*/
+static void
+channel_open(struct channel *ch, uint16_t channelno, uint8_t type)
+{
+  ch->channelno = channelno;
+  ch->type = type;
+  ch->next = sim_current->channels;
+  sim_current->channels = ch;
+}
+/*---------------------------------------------------------------------------*/
+static void
+channel_close(struct channel *ch)
+{
+  struct channel **p;
+  if(sim_current == NULL) {
+    return;
+  }
+  for(p = &sim_current->channels; *p != NULL; p = &(*p)->next) {
+    if(*p == ch) {
+      *p = ch->next;
+      return;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+static struct channel *
+channel_lookup(struct sim_node *n, uint16_t channelno, uint8_t type)
+{
+  struct channel *ch, *found = NULL;
+  /* Like Rime, the connection opened first on a channel gets the frame */
+  for(ch = n->channels; ch != NULL; ch = ch->next) {
+    if(ch->channelno == channelno) {
+      found = ch;
+    }
+  }
+  return found != NULL && found->type == type ? found : NULL;
+}
+/*---------------------------------------------------------------------------*/
+void
+sim_radio_node_reset(struct sim_node *n)
+{
+  n->channels = NULL;
+  if(tx_free_at != NULL) {
+    free(tx_free_at);
+    tx_free_at = NULL;
+    tx_free_len = 0;
+  }
+}
+/*-RADIO---------------------------------------------------------------------*/
+static void frame_input(void *arg);
+/*---------------------------------------------------------------------------*/
+static uint64_t
+transmit_start(struct sim_node *n, uint16_t len)
+{
+  uint64_t start, airtime = (uint64_t)(len + FRAME_OVERHEAD) * US_PER_BYTE;
+  if(tx_free_len < sim_num_nodes) {
+    tx_free_at = realloc(tx_free_at, sim_num_nodes * sizeof(uint64_t));
+    memset(tx_free_at + tx_free_len, 0,
+           (sim_num_nodes - tx_free_len) * sizeof(uint64_t));
+    tx_free_len = sim_num_nodes;
+  }
+  /* The radio sends one frame at a time, later frames queue up behind */
+  start = sim_local_time();
+  if(tx_free_at[n->id] > start) {
+    start = tx_free_at[n->id];
+  }
+  tx_free_at[n->id] = start + airtime;
+  n->stats.tx_bytes += len + FRAME_OVERHEAD;
+  n->stats.tx_us += airtime;
+  n->stats.tx_nj += airtime * power_current_ua(n->tx_power) * SUPPLY_V / 1000;
+  return start + airtime;
+}
+/*---------------------------------------------------------------------------*/
+static void
+deliver(const struct frame *f, int dst, uint64_t at)
+{
+  float loss = sim_link_loss(f->src, dst);
+  struct frame *copy;
+  if(loss < 0) {
+    return;
+  }
+  if(sim_nodes[f->src].tx_power < SIM_POWER_MAX
+     && !mobility_reaches(f->src, dst,
+                          power_range(sim_nodes[f->src].tx_power))) {
+    return;
+  }
+  if(loss > 0 && sim_rand_unit() < loss) {
+    sim_nodes[dst].stats.rx_lost++;
+    return;
+  }
+  copy = malloc(sizeof(struct frame));
+  memcpy(copy, f, offsetof(struct frame, data) + f->len);
+  copy->dst = dst;
+  sim_schedule(at, dst, SIM_EV_RX, frame_input, copy);
+}
+/*---------------------------------------------------------------------------*/
+static void
+transmit(struct frame *f)
+{
+  struct sim_node *n = &sim_nodes[f->src];
+  uint64_t at = transmit_start(n, f->len);
+  int i;
+  if(f->dst >= 0) {
+    deliver(f, f->dst, at);
+    return;
+  }
+  for(i = 0; i < sim_num_nodes; i++) {
+    if(i != f->src) {
+      deliver(f, i, at);
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+frame_from_packetbuf(struct frame *f, struct channel *ch, int dst)
+{
+  f->src = sim_current->id;
+  f->dst = dst;
+  f->channelno = ch->channelno;
+  f->type = ch->type;
+  f->ack = 0;
+  f->seqno = 0;
+  f->len = packetbuf_copyto(f->data);
+}
+/*---------------------------------------------------------------------------*/
+static void runicast_ack_input(struct runicast_conn *c, const struct frame *f);
+/*---------------------------------------------------------------------------*/
+static void
+frame_input(void *arg)
+{
+  struct frame *f = arg;
+  struct sim_node *n = &sim_nodes[f->dst];
+  struct channel *ch = channel_lookup(n, f->channelno, f->type);
+  const rimeaddr_t *from = &sim_nodes[f->src].addr;
+  if(ch == NULL) {
+    free(f);
+    return;
+  }
+  n->stats.rx++;
+  packetbuf_copyfrom(f->data, f->len);
+  packetbuf_set_addr(PACKETBUF_ADDR_SENDER, from);
+  packetbuf_set_addr(PACKETBUF_ADDR_RECEIVER,
+                     f->type == CHANNEL_BROADCAST ? &rimeaddr_null : &n->addr);
+  switch(f->type) {
+  case CHANNEL_BROADCAST: {
+    struct broadcast_conn *c = (struct broadcast_conn *)ch;
+    if(c->u->recv != NULL) {
+      c->u->recv(c, from);
+    }
+    break;
+  }
+  case CHANNEL_UNICAST: {
+    struct unicast_conn *c = (struct unicast_conn *)ch;
+    if(c->u->recv != NULL) {
+      c->u->recv(c, from);
+    }
+    break;
+  }
+  case CHANNEL_RUNICAST: {
+    struct runicast_conn *c = (struct runicast_conn *)ch;
+    if(f->ack) {
+      runicast_ack_input(c, f);
+    } else {
+      struct frame ack;
+      ack.src = n->id;
+      ack.dst = f->src;
+      ack.channelno = f->channelno;
+      ack.type = CHANNEL_RUNICAST;
+      ack.ack = 1;
+      ack.seqno = f->seqno;
+      ack.len = 0;
+      n->stats.runicast_ack_tx++;
+      transmit(&ack);
+      if(c->u->recv != NULL) {
+        c->u->recv(c, from, f->seqno);
+      }
+    }
+    break;
+  }
+  }
+  free(f);
+}
+/*-BROADCAST-----------------------------------------------------------------*/
+void
+broadcast_open(struct broadcast_conn *c, uint16_t channel,
+               const struct broadcast_callbacks *u)
+{
+  c->u = u;
+  channel_open(&c->channel, channel, CHANNEL_BROADCAST);
+}
+/*---------------------------------------------------------------------------*/
+void
+broadcast_close(struct broadcast_conn *c)
+{
+  channel_close(&c->channel);
+}
+/*---------------------------------------------------------------------------*/
+int
+broadcast_send(struct broadcast_conn *c)
+{
+  struct frame f;
+  frame_from_packetbuf(&f, &c->channel, -1);
+  sim_current->stats.broadcast_tx++;
+  transmit(&f);
+  return 1;
+}
+/*-UNICAST-------------------------------------------------------------------*/
+void
+unicast_open(struct unicast_conn *c, uint16_t channel,
+             const struct unicast_callbacks *u)
+{
+  c->u = u;
+  channel_open(&c->channel, channel, CHANNEL_UNICAST);
+}
+/*---------------------------------------------------------------------------*/
+void
+unicast_close(struct unicast_conn *c)
+{
+  channel_close(&c->channel);
+}
+/*---------------------------------------------------------------------------*/
+int
+unicast_send(struct unicast_conn *c, const rimeaddr_t *receiver)
+{
+  struct frame f;
+  struct sim_node *to = sim_node_by_addr(receiver);
+  if(to == NULL) {
+    return 0;
+  }
+  frame_from_packetbuf(&f, &c->channel, to->id);
+  sim_current->stats.unicast_tx++;
+  transmit(&f);
+  return 1;
+}
+/*-RUNICAST------------------------------------------------------------------*/
+static void runicast_rxmit(void *ptr);
+/*---------------------------------------------------------------------------*/
+static void
+runicast_transmit(struct runicast_conn *c)
+{
+  struct frame *f = (struct frame *)c->frame;
+  int shift = c->rxmit + 1 > 4 ? 4 : c->rxmit + 1;
+  sim_current->stats.runicast_tx++;
+  transmit(f);
+  ctimer_set(&c->rxmit_timer, REXMIT_TIME << shift, runicast_rxmit, c);
+}
+/*---------------------------------------------------------------------------*/
+static void
+runicast_finish(struct runicast_conn *c)
+{
+  ctimer_stop(&c->rxmit_timer);
+  free(c->frame);
+  c->frame = NULL;
+  c->is_tx = 0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+runicast_rxmit(void *ptr)
+{
+  struct runicast_conn *c = ptr;
+  rimeaddr_t to;
+  uint8_t rxmit;
+  if(!c->is_tx) {
+    return;
+  }
+  if(c->rxmit + 1 >= c->max_rxmit) {
+    rimeaddr_copy(&to, &c->receiver);
+    rxmit = c->rxmit;
+    runicast_finish(c);
+    sim_current->stats.runicast_timedout++;
+    if(c->u->timedout != NULL) {
+      c->u->timedout(c, &to, rxmit);
+    }
+    return;
+  }
+  c->rxmit++;
+  runicast_transmit(c);
+}
+/*---------------------------------------------------------------------------*/
+static void
+runicast_ack_input(struct runicast_conn *c, const struct frame *f)
+{
+  rimeaddr_t to;
+  uint8_t rxmit;
+  if(!c->is_tx || f->seqno != c->sndnxt
+     || !rimeaddr_cmp(&sim_nodes[f->src].addr, &c->receiver)) {
+    return;
+  }
+  rimeaddr_copy(&to, &c->receiver);
+  rxmit = c->rxmit;
+  runicast_finish(c);
+  c->sndnxt = (c->sndnxt + 1) % (1 << RUNICAST_PACKET_ID_BITS);
+  sim_current->stats.runicast_sent++;
+  if(c->u->sent != NULL) {
+    c->u->sent(c, &to, rxmit);
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+runicast_open(struct runicast_conn *c, uint16_t channel,
+              const struct runicast_callbacks *u)
+{
+  c->u = u;
+  c->frame = NULL;
+  c->is_tx = 0;
+  c->sndnxt = 0;
+  channel_open(&c->channel, channel, CHANNEL_RUNICAST);
+}
+/*---------------------------------------------------------------------------*/
+void
+runicast_close(struct runicast_conn *c)
+{
+  if(c->is_tx) {
+    runicast_finish(c);
+  }
+  channel_close(&c->channel);
+}
+/*---------------------------------------------------------------------------*/
+uint8_t
+runicast_is_transmitting(struct runicast_conn *c)
+{
+  return c->is_tx;
+}
+/*---------------------------------------------------------------------------*/
+int
+runicast_send(struct runicast_conn *c, const rimeaddr_t *receiver,
+              uint8_t max_retransmissions)
+{
+  struct sim_node *to = sim_node_by_addr(receiver);
+  struct frame *f;
+  if(c->is_tx || to == NULL) {
+    return 0;
+  }
+  f = malloc(sizeof(struct frame));
+  frame_from_packetbuf(f, &c->channel, to->id);
+  f->seqno = c->sndnxt;
+  c->frame = (uint8_t *)f;
+  rimeaddr_copy(&c->receiver, receiver);
+  c->max_rxmit = max_retransmissions;
+  c->rxmit = 0;
+  c->is_tx = 1;
+  runicast_transmit(c);
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,381 @@
+/**
+ * \file
+ *     Discrete-event engine of the host-native DTN simulator
+ */
+#include "sim.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct sim_event {
+  uint64_t at;
+  uint64_t seq;
+  int node;
+  int kind;
+  sim_event_fn fn;
+  void *arg;
+};
+
+uint64_t sim_now;
+struct sim_node *sim_nodes;
+int sim_num_nodes;
+struct sim_node *sim_current;
+
+static struct sim_event *heap;
+static size_t heap_len, heap_cap;
+static uint64_t next_seq;
+static uint32_t rand_state;
+
+static float *links;
+static FILE *trace_out;
+/*---------------------------------------------------------------------------*/
+uint32_t
+sim_rand(void)
+{
+  /* xorshift32 */
+  rand_state ^= rand_state << 13;
+  rand_state ^= rand_state >> 17;
+  rand_state ^= rand_state << 5;
+  return rand_state;
+}
+/*---------------------------------------------------------------------------*/
+double
+sim_rand_unit(void)
+{
+  return (sim_rand() >> 8) / (double)(1 << 24);
+}
+/*-EVENT QUEUE---------------------------------------------------------------*/
+static int
+event_before(const struct sim_event *a, const struct sim_event *b)
+{
+  return a->at < b->at || (a->at == b->at && a->seq < b->seq);
+}
+/*---------------------------------------------------------------------------*/
+static void
+heap_push(struct sim_event *e)
+{
+  size_t i;
+  if(heap_len == heap_cap) {
+    heap_cap = heap_cap ? heap_cap * 2 : 1024;
+    heap = realloc(heap, heap_cap * sizeof(struct sim_event));
+    if(heap == NULL) {
+      fprintf(stderr, "sim: out of memory\n");
+      exit(1);
+    }
+  }
+  i = heap_len++;
+  while(i > 0 && event_before(e, &heap[(i - 1) / 2])) {
+    heap[i] = heap[(i - 1) / 2];
+    i = (i - 1) / 2;
+  }
+  heap[i] = *e;
+}
+/*---------------------------------------------------------------------------*/
+static void
+heap_pop(struct sim_event *e)
+{
+  struct sim_event last;
+  size_t i, child;
+  *e = heap[0];
+  last = heap[--heap_len];
+  i = 0;
+  while((child = 2 * i + 1) < heap_len) {
+    if(child + 1 < heap_len && event_before(&heap[child + 1], &heap[child])) {
+      child++;
+    }
+    if(!event_before(&heap[child], &last)) {
+      break;
+    }
+    heap[i] = heap[child];
+    i = child;
+  }
+  heap[i] = last;
+}
+/*---------------------------------------------------------------------------*/
+void
+sim_schedule(uint64_t at, int node, int kind, sim_event_fn fn, void *arg)
+{
+  struct sim_event e;
+  e.at = at;
+  e.seq = next_seq++;
+  e.node = node;
+  e.kind = kind;
+  e.fn = fn;
+  e.arg = arg;
+  heap_push(&e);
+}
+/*-NODES---------------------------------------------------------------------*/
+void
+sim_enter(struct sim_node *n)
+{
+  sim_current = n;
+  rimeaddr_copy(&rimeaddr_node_addr, &n->addr);
+}
+/*---------------------------------------------------------------------------*/
+void
+sim_leave(void)
+{
+  struct sim_node *n = sim_current;
+  if(n != NULL && n->busy_until > sim_now) {
+    n->stats.busy_us += n->busy_until - sim_now;
+  }
+  sim_current = NULL;
+}
+/*---------------------------------------------------------------------------*/
+uint64_t
+sim_local_time(void)
+{
+  if(sim_current != NULL && sim_current->busy_until > sim_now) {
+    return sim_current->busy_until;
+  }
+  return sim_now;
+}
+/*---------------------------------------------------------------------------*/
+struct sim_node *
+sim_node_by_addr(const rimeaddr_t *addr)
+{
+  int id = (addr->u8[1] << 8 | addr->u8[0]) - 1;
+  if(id < 0 || id >= sim_num_nodes) {
+    return NULL;
+  }
+  return &sim_nodes[id];
+}
+/*---------------------------------------------------------------------------*/
+void
+sim_init(int num_nodes, uint32_t seed)
+{
+  int i;
+  sim_now = 0;
+  next_seq = 0;
+  heap_len = 0;
+  rand_state = seed ? seed : 0x5eed;
+  sim_num_nodes = num_nodes;
+  sim_nodes = calloc(num_nodes, sizeof(struct sim_node));
+  links = malloc((size_t)num_nodes * num_nodes * sizeof(float));
+  if(sim_nodes == NULL || links == NULL) {
+    fprintf(stderr, "sim: out of memory\n");
+    exit(1);
+  }
+  sim_link_set_all(-1);
+  for(i = 0; i < num_nodes; i++) {
+    struct sim_node *n = &sim_nodes[i];
+    n->id = i;
+    n->addr.u8[0] = (i + 1) & 0xff;
+    n->addr.u8[1] = (i + 1) >> 8;
+    n->rand_state = sim_rand() | 1;
+    n->tx_power = SIM_POWER_MAX;
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+sim_free(void)
+{
+  int i;
+  for(i = 0; i < sim_num_nodes; i++) {
+    sim_packetqueue_node_reset(&sim_nodes[i]);
+    sim_radio_node_reset(&sim_nodes[i]);
+  }
+  sim_cfs_reset();
+  free(sim_nodes);
+  free(links);
+  free(heap);
+  sim_nodes = NULL;
+  links = NULL;
+  heap = NULL;
+  heap_len = heap_cap = 0;
+}
+/*---------------------------------------------------------------------------*/
+static int
+defer_if_busy(struct sim_event *e, struct sim_node *n)
+{
+  if(n->busy_until <= e->at) {
+    return 0;
+  }
+  if(e->kind == SIM_EV_RX) {
+    if(n->rx_pending >= SIM_RX_FIFO) {
+      n->stats.rx_overflow++;
+      free(e->arg);
+      return 1;
+    }
+    n->rx_pending++;
+  }
+  e->at = n->busy_until;
+  e->seq = next_seq++;
+  heap_push(e);
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+void
+sim_run(uint64_t until)
+{
+  struct sim_event e;
+  while(heap_len > 0 && heap[0].at <= until) {
+    heap_pop(&e);
+    sim_now = e.at;
+    if(e.node < 0) {
+      e.fn(e.arg);
+      continue;
+    }
+    if(defer_if_busy(&e, &sim_nodes[e.node])) {
+      continue;
+    }
+    if(e.kind == SIM_EV_RX && sim_nodes[e.node].rx_pending > 0) {
+      sim_nodes[e.node].rx_pending--;
+    }
+    sim_enter(&sim_nodes[e.node]);
+    e.fn(e.arg);
+    sim_leave();
+  }
+  sim_now = until;
+}
+/*-LINKS---------------------------------------------------------------------*/
+void
+sim_link_set_all(float loss)
+{
+  size_t i, n = (size_t)sim_num_nodes * sim_num_nodes;
+  for(i = 0; i < n; i++) {
+    links[i] = loss;
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+sim_link_set(int a, int b, float loss)
+{
+  float old = links[(size_t)a * sim_num_nodes + b];
+  if(trace_out != NULL && (old < 0) != (loss < 0)) {
+    fprintf(trace_out, "%.3f CONN %d %d %s\n",
+            (double)sim_now / SIM_USEC_PER_SEC, a, b, loss < 0 ? "down" : "up");
+  }
+  links[(size_t)a * sim_num_nodes + b] = loss;
+  links[(size_t)b * sim_num_nodes + a] = loss;
+}
+/*---------------------------------------------------------------------------*/
+float
+sim_link_loss(int a, int b)
+{
+  if(a == b) {
+    return -1;
+  }
+  return links[(size_t)a * sim_num_nodes + b];
+}
+/*-CONTACTS------------------------------------------------------------------*/
+struct contact {
+  int a, b;
+  float loss;
+};
+/*---------------------------------------------------------------------------*/
+static void
+contact_up(void *arg)
+{
+  struct contact *ct = arg;
+  sim_link_set(ct->a, ct->b, ct->loss);
+}
+/*---------------------------------------------------------------------------*/
+static void
+contact_down(void *arg)
+{
+  struct contact *ct = arg;
+  sim_link_set(ct->a, ct->b, -1);
+  free(ct);
+}
+/*---------------------------------------------------------------------------*/
+static void
+contact_once(void *arg)
+{
+  struct contact *ct = arg;
+  sim_link_set(ct->a, ct->b, ct->loss);
+  free(ct);
+}
+/*---------------------------------------------------------------------------*/
+void
+sim_contact_add(uint64_t start, uint64_t end, int a, int b, float loss)
+{
+  struct contact *ct;
+  if(a < 0 || b < 0 || a >= sim_num_nodes || b >= sim_num_nodes || a == b
+     || end <= start) {
+    return;
+  }
+  ct = malloc(sizeof(struct contact));
+  ct->a = a;
+  ct->b = b;
+  ct->loss = loss;
+  sim_schedule(start, -1, SIM_EV_GLOBAL, contact_up, ct);
+  sim_schedule(end, -1, SIM_EV_GLOBAL, contact_down, ct);
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Contact plan: one contact per line, "start end a b [loss]", with times in
+ * seconds and nodes as 0-based indices. Lines starting with '#' are ignored.
+ */
+int
+sim_contacts_load(const char *path, float default_loss)
+{
+  FILE *f;
+  char line[256];
+  int count = 0;
+  f = fopen(path, "r");
+  if(f == NULL) {
+    return -1;
+  }
+  while(fgets(line, sizeof(line), f) != NULL) {
+    double start, end;
+    int a, b, fields;
+    float loss = default_loss;
+    if(line[0] == '#') {
+      continue;
+    }
+    fields = sscanf(line, "%lf %lf %d %d %f", &start, &end, &a, &b, &loss);
+    if(fields < 4) {
+      continue;
+    }
+    sim_contact_add((uint64_t)(start * SIM_USEC_PER_SEC),
+                    (uint64_t)(end * SIM_USEC_PER_SEC), a, b, loss);
+    count++;
+  }
+  fclose(f);
+  return count;
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Connectivity trace in the format of the ONE simulator's
+ * StandardEventsReader: "time CONN a b up|down". Other events are ignored.
+ */
+int
+sim_trace_load(const char *path, float loss)
+{
+  FILE *f;
+  char line[256], state[8];
+  int count = 0;
+  f = fopen(path, "r");
+  if(f == NULL) {
+    return -1;
+  }
+  while(fgets(line, sizeof(line), f) != NULL) {
+    double t;
+    int a, b;
+    struct contact *ct;
+    if(sscanf(line, "%lf CONN %d %d %7s", &t, &a, &b, state) != 4) {
+      continue;
+    }
+    if(a < 0 || b < 0 || a >= sim_num_nodes || b >= sim_num_nodes || a == b) {
+      continue;
+    }
+    ct = malloc(sizeof(struct contact));
+    ct->a = a;
+    ct->b = b;
+    ct->loss = strcmp(state, "up") == 0 ? loss : -1;
+    sim_schedule((uint64_t)(t * SIM_USEC_PER_SEC), -1, SIM_EV_GLOBAL,
+                 contact_once, ct);
+    count++;
+  }
+  fclose(f);
+  return count;
+}
+/*---------------------------------------------------------------------------*/
+void
+sim_trace_record(FILE *f)
+{
+  trace_out = f;
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,113 @@
+/**
+ * \file
+ *     Discrete-event engine of the host-native DTN simulator
+ *
+ *     The simulator runs many virtual nodes in one process. Every piece of
+ *     per-node state that Contiki keeps in globals (the node address, the
+ *     random generator, registered Rime channels, packet queues) is swapped
+ *     in by sim_enter() before any callback of that node runs.
+ */
+#ifndef SIM_H
+#define SIM_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "net/rime.h"
+
+#define SIM_USEC_PER_SEC 1000000ULL
+
+/** Frames received while a node busy-waits are held in a one-frame FIFO */
+#define SIM_RX_FIFO 1
+
+/**
+ * Highest set_power() level, the one nodes start at and the only one that
+ * reaches the full range
+ */
+#define SIM_POWER_MAX 0x12
+
+typedef void (* sim_event_fn)(void *arg);
+
+enum {
+  SIM_EV_CPU,   /**< Deferred until the node is done busy-waiting */
+  SIM_EV_RX,    /**< Frame reception, subject to the RX FIFO */
+  SIM_EV_GLOBAL /**< Not bound to a node */
+};
+
+struct sim_pq;
+
+struct sim_radio_stats {
+  unsigned long broadcast_tx;
+  unsigned long unicast_tx;
+  unsigned long runicast_tx;    /**< Data transmissions incl. retransmits */
+  unsigned long runicast_ack_tx;
+  unsigned long runicast_sent;
+  unsigned long runicast_timedout;
+  unsigned long rx;
+  unsigned long rx_lost;        /**< Dropped by the link loss model */
+  unsigned long rx_overflow;    /**< Dropped while the node was busy */
+  unsigned long long tx_bytes;
+  unsigned long long tx_us;     /**< Airtime of the frames sent */
+  unsigned long long tx_nj;     /**< Energy spent sending them */
+  unsigned long long busy_us;   /**< Time spent in clock_delay_usec() */
+};
+
+struct sim_node {
+  int id;
+  rimeaddr_t addr;
+  uint32_t rand_state;
+  uint64_t busy_until;
+  uint8_t rx_pending;
+  struct channel *channels;
+  struct sim_pq *queues;
+  int queuebufs;
+  uint8_t tx_power;             /**< Level set with set_power() */
+  struct sim_radio_stats stats;
+  void *app;
+};
+
+extern uint64_t sim_now;
+extern struct sim_node *sim_nodes;
+extern int sim_num_nodes;
+extern struct sim_node *sim_current;
+
+void sim_init(int num_nodes, uint32_t seed);
+void sim_free(void);
+void sim_run(uint64_t until);
+
+/** Current time as seen by the running node, including its busy-waits */
+uint64_t sim_local_time(void);
+
+void sim_schedule(uint64_t at, int node, int kind,
+                  sim_event_fn fn, void *arg);
+
+void sim_enter(struct sim_node *n);
+void sim_leave(void);
+
+struct sim_node *sim_node_by_addr(const rimeaddr_t *addr);
+
+/** Simulator-wide random numbers, independent of the nodes' generators */
+uint32_t sim_rand(void);
+double sim_rand_unit(void);
+
+/**
+ * Link model. A negative loss means there is no link between the nodes;
+ * otherwise it is the probability that a frame is lost on the link.
+ */
+void sim_link_set_all(float loss);
+void sim_link_set(int a, int b, float loss);
+float sim_link_loss(int a, int b);
+void sim_contact_add(uint64_t start, uint64_t end, int a, int b, float loss);
+int sim_contacts_load(const char *path, float default_loss);
+int sim_trace_load(const char *path, float loss);
+/** Write every link change as a connectivity trace that sim_trace_load reads */
+void sim_trace_record(FILE *f);
+
+/** Keep the nodes' CFS files in this directory instead of a temporary one */
+void sim_cfs_dir(const char *path);
+
+/* Hooks into the simulated Contiki pieces */
+void sim_radio_node_reset(struct sim_node *n);
+void sim_packetqueue_node_reset(struct sim_node *n);
+void sim_cfs_reset(void);
+
+#endif /* SIM_H */